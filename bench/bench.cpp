@@ -0,0 +1,133 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "bench.h"
+
+#include <cstdio>
+
+namespace RayGene3D
+{
+  namespace
+  {
+    volatile uint64_t sink = 0;
+  }
+
+  void Bench::Keep(uint64_t value)
+  {
+    sink = sink + value;
+  }
+
+  bool Bench::IsSelected(const std::string& suite, const std::string& name) const
+  {
+    return filter.empty() || (suite + '.' + name).find(filter) != std::string::npos;
+  }
+
+  bool Bench::IsSuiteSelected(const std::string& suite) const
+  {
+    return filter.empty() || (suite + '.').find(filter) != std::string::npos || filter.compare(0, suite.length() + 1, suite + '.') == 0;
+  }
+
+  Bench::Result* Bench::Run(const std::string& suite, const std::string& name, uint64_t param, const body_t& body, uint64_t bytes)
+  {
+    if (!IsSelected(suite, name))
+    {
+      return nullptr;
+    }
+
+    const auto time_fn = [&body](uint64_t iterations)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      body(iterations);
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    };
+
+    // grows the iteration count until one measurement takes the minimum time
+    uint64_t iterations = 1;
+    for (auto elapsed = time_fn(iterations); elapsed < min_time; elapsed = time_fn(iterations))
+    {
+      const auto scale = elapsed.count() > 0 ? double(min_time.count()) / double(elapsed.count()) : 100.0;
+      iterations = std::max(iterations + 1, uint64_t(double(iterations) * std::min(100.0, scale * 1.2)));
+    }
+
+    std::vector<double> samples(repeats);
+    for (auto& sample : samples)
+    {
+      sample = double(time_fn(iterations).count()) / double(iterations);
+    }
+    std::sort(samples.begin(), samples.end());
+
+    Result result;
+    result.suite = suite;
+    result.name = name;
+    result.param = param;
+    result.iterations = iterations;
+    result.ns_median = samples[samples.size() / 2];
+    result.ns_min = samples.front();
+    result.ns_max = samples.back();
+    result.bytes = bytes;
+    results.push_back(result);
+
+    std::fprintf(stderr, "%-12s %-28s %10llu %14.1f ns/op", suite.c_str(), name.c_str(), (unsigned long long)param, result.ns_median);
+    if (bytes != 0) std::fprintf(stderr, " %10.2f GiB/s", double(bytes) / result.ns_median * 1e9 / double(1 << 30));
+    std::fprintf(stderr, "\n");
+
+    return &results.back();
+  }
+
+  nlohmann::json Bench::ToJSON() const
+  {
+    auto json = nlohmann::json::object();
+    json["library"] = "raygene3d-util";
+    json["timestamp"] = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+#ifdef NDEBUG
+    json["build"] = "release";
+#else
+    json["build"] = "debug";
+#endif
+    json["repeats"] = repeats;
+    json["min_time_ns"] = min_time.count();
+
+    auto& items = json["results"] = nlohmann::json::array();
+    for (const auto& result : results)
+    {
+      nlohmann::json item;
+      item["suite"] = result.suite;
+      item["name"] = result.name;
+      item["param"] = result.param;
+      item["iterations"] = result.iterations;
+      item["ns_per_op"] = result.ns_median;
+      item["ns_min"] = result.ns_min;
+      item["ns_max"] = result.ns_max;
+      if (result.bytes != 0) item["bytes_per_second"] = double(result.bytes) / result.ns_median * 1e9;
+      for (const auto& [key, value] : result.counters) item["counters"][key] = value;
+      items.push_back(std::move(item));
+    }
+    return json;
+  }
+}
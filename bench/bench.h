@@ -0,0 +1,89 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+#pragma once
+#include "../util.h"
+
+#include <chrono>
+
+namespace RayGene3D
+{
+  // Self-contained benchmark harness. A case body runs its operation the
+  // given number of times; the harness calibrates that number to a minimum
+  // duration, repeats the measurement and reports the median per operation.
+  class Bench
+  {
+  public:
+    typedef std::function<void(uint64_t iterations)> body_t;
+
+    struct Result
+    {
+      std::string suite;
+      std::string name;
+      uint64_t param{ 0 };
+      uint64_t iterations{ 0 };
+      double ns_median{ 0.0 };
+      double ns_min{ 0.0 };
+      double ns_max{ 0.0 };
+      uint64_t bytes{ 0 };  // processed per operation, 0 when not meaningful
+      std::map<std::string, double> counters;
+    };
+
+  protected:
+    std::vector<Result> results;
+    std::string filter;
+    std::chrono::nanoseconds min_time{ std::chrono::milliseconds(100) };
+    uint32_t repeats{ 5 };
+    bool large{ false };
+
+  public:
+    void SetFilter(const std::string& filter) { this->filter = filter; }
+    void SetQuick(bool quick) { min_time = quick ? std::chrono::milliseconds(10) : std::chrono::milliseconds(100); repeats = quick ? 3 : 5; }
+    void SetLarge(bool large) { this->large = large; }
+    bool IsLarge() const { return large; }
+
+  public:
+    bool IsSelected(const std::string& suite, const std::string& name) const;
+    // whether any case of the suite may be selected, to skip expensive setup
+    bool IsSuiteSelected(const std::string& suite) const;
+    // null when the case is filtered out
+    Result* Run(const std::string& suite, const std::string& name, uint64_t param, const body_t& body, uint64_t bytes = 0);
+
+  public:
+    // folds a value into a volatile sink so the work producing it is kept
+    static void Keep(uint64_t value);
+
+  public:
+    const std::vector<Result>& GetResults() const { return results; }
+    nlohmann::json ToJSON() const;
+  };
+
+  void RunCodecBench(Bench& bench);
+  void RunPropertyBench(Bench& bench);
+  void RunRawBench(Bench& bench);
+}
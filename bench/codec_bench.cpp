@@ -0,0 +1,133 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "bench.h"
+#include "../util/compression.h"
+
+#include <cmath>
+
+namespace RayGene3D
+{
+  namespace
+  {
+    // a height field grid, rows of triangle pairs as a mesh optimiser would order them
+    void MakeGrid(uint32_t size, std::vector<Vertex>& vertices, std::vector<Triangle>& triangles)
+    {
+      for (uint32_t y = 0; y < size; ++y)
+      {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+          Vertex vertex;
+          vertex.pos = { x * 0.1f, std::sin(x * 0.05f) * std::cos(y * 0.05f), y * 0.1f };
+          vertex.nrm = { 0.0f, 1.0f, 0.0f };
+          vertex.tng = { 1.0f, 0.0f, 0.0f };
+          vertex.sgn = 1.0f;
+          vertex.tc0 = { x / float(size), y / float(size) };
+          vertex.tc1 = vertex.tc0;
+          vertices.push_back(vertex);
+        }
+      }
+
+      for (uint32_t y = 0; y + 1 < size; ++y)
+      {
+        for (uint32_t x = 0; x + 1 < size; ++x)
+        {
+          const auto i = y * size + x;
+          Triangle first;
+          first.idx = { i, i + 1, i + size };
+          triangles.push_back(first);
+          Triangle second;
+          second.idx = { i + 1, i + size + 1, i + size };
+          triangles.push_back(second);
+        }
+      }
+    }
+  }
+
+  void RunCodecBench(Bench& bench)
+  {
+    if (!bench.IsSuiteSelected("codec"))
+    {
+      return;
+    }
+
+    // bytes are the decoded output, so the rates compare with memcpy
+    const auto size = bench.IsLarge() ? 1024u : 256u;
+    std::vector<Vertex> vertices;
+    std::vector<Triangle> triangles;
+    MakeGrid(size, vertices, triangles);
+    const auto vertex_count = uint32_t(vertices.size());
+    const auto triangle_count = uint32_t(triangles.size());
+    const std::pair<const void*, uint32_t> vertex_bytes = { vertices.data(), vertex_count * uint32_t(sizeof(Vertex)) };
+    const std::pair<const void*, uint32_t> triangle_bytes = { triangles.data(), triangle_count * uint32_t(sizeof(Triangle)) };
+
+    std::vector<Vertex> decoded_vertices(vertex_count);
+    std::vector<Triangle> decoded_triangles(triangle_count);
+
+    for (const auto bits : { 0u, 16u })
+    {
+      const auto encoded = EncodeVertices(vertices.data(), vertex_count, bits, bits);
+      bench.Run("codec", bits == 0 ? "decode_vertices" : "decode_vertices_quantised", vertex_count, [&encoded, &decoded_vertices, vertex_count](uint64_t iterations)
+        {
+          for (uint64_t i = 0; i < iterations; ++i)
+          {
+            Bench::Keep(uint64_t(DecodeVertices({ encoded.data(), uint32_t(encoded.size()) }, decoded_vertices.data(), vertex_count)));
+          }
+        }, vertex_bytes.second);
+    }
+
+    {
+      const auto encoded = EncodeTriangles(triangles.data(), triangle_count);
+      const auto result = bench.Run("codec", "decode_triangles", triangle_count, [&encoded, &decoded_triangles, triangle_count](uint64_t iterations)
+        {
+          for (uint64_t i = 0; i < iterations; ++i)
+          {
+            Bench::Keep(uint64_t(DecodeTriangles({ encoded.data(), uint32_t(encoded.size()) }, decoded_triangles.data(), triangle_count)));
+          }
+        }, triangle_bytes.second);
+      if (result) result->counters["encoded_bytes"] = double(encoded.size());
+    }
+
+    // the whole load path, LZ4 chunks included
+    for (const auto& [name, count, bytes, layout] : { std::make_tuple("decompress_vertices", vertex_count, vertex_bytes, Raw::LAYOUT_VERTEX),
+      std::make_tuple("decompress_triangles", triangle_count, triangle_bytes, Raw::LAYOUT_TRIANGLE) })
+    {
+      const auto packed = CompressGeometry(bytes, layout, 1u << 16, 0, 0);
+      std::vector<uint8_t> raw;
+      const auto result = bench.Run("codec", name, count, [&packed, &raw](uint64_t iterations)
+        {
+          for (uint64_t i = 0; i < iterations; ++i)
+          {
+            Bench::Keep(uint64_t(DecompressGeometry({ packed.data(), uint32_t(packed.size()) }, raw)));
+          }
+        }, bytes.second);
+      if (result) result->counters["ratio"] = double(packed.size()) / double(bytes.second);
+    }
+  }
+}
@@ -0,0 +1,71 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "bench.h"
+
+#include <cstdio>
+
+using namespace RayGene3D;
+
+// usage: raygene3d-util-bench [--json file] [--filter text] [--quick] [--large]
+// The JSON report goes to stdout unless a file is given, progress to stderr.
+int main(int argc, char** argv)
+{
+  Bench bench;
+  std::string json_file;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const auto arg = std::string(argv[i]);
+    if (arg == "--json" && i + 1 < argc) json_file = argv[++i];
+    else if (arg == "--filter" && i + 1 < argc) bench.SetFilter(argv[++i]);
+    else if (arg == "--quick") bench.SetQuick(true);
+    else if (arg == "--large") bench.SetLarge(true);
+    else
+    {
+      std::fprintf(stderr, "unknown argument %s\n", arg.c_str());
+      return 1;
+    }
+  }
+
+  RunPropertyBench(bench);
+  RunRawBench(bench);
+  RunCodecBench(bench);
+
+  const auto report = bench.ToJSON().dump(2);
+  if (json_file.empty())
+  {
+    std::printf("%s\n", report.c_str());
+    return 0;
+  }
+
+  std::ofstream file_stream(json_file, std::ios::out);
+  file_stream << report << std::endl;
+  return file_stream ? 0 : 1;
+}
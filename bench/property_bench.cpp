@@ -0,0 +1,185 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "bench.h"
+
+namespace RayGene3D
+{
+  namespace
+  {
+    std::vector<Instance> MakeInstances(uint32_t count)
+    {
+      std::vector<Instance> instances(count);
+      for (uint32_t i = 0; i < count; ++i)
+      {
+        auto& instance = instances[i];
+        instance.transform = glm::f32mat3x4(1.0f);
+        instance.transform[0][3] = float(i);
+        instance.prim_offset = i * 64;
+        instance.prim_count = 64;
+        instance.vert_offset = i * 48;
+        instance.vert_count = 48;
+        instance.diffuse = glm::f32vec3(float(i % 7) / 7.0f, 0.5f, 0.25f);
+        instance.geometry_idx = i % 16;
+      }
+      return instances;
+    }
+
+    std::shared_ptr<Property> MakeObject(uint32_t count)
+    {
+      const auto object = std::shared_ptr<Property>(new Property(Property::TYPE_OBJECT));
+      for (uint32_t i = 0; i < count; ++i)
+      {
+        object->SetObjectItem("item_" + std::to_string(i), CreateUIntProperty());
+      }
+      return object;
+    }
+  }
+
+  void RunPropertyBench(Bench& bench)
+  {
+    bench.Run("property", "create_float", 1, [](uint64_t iterations)
+      {
+        for (uint64_t i = 0; i < iterations; ++i) Bench::Keep(uint64_t(CreateFloatProperty().get() != nullptr));
+      });
+    bench.Run("property", "create_fvec3", 3, [](uint64_t iterations)
+      {
+        for (uint64_t i = 0; i < iterations; ++i) Bench::Keep(uint64_t(CreateFVec3Property().get() != nullptr));
+      });
+    bench.Run("property", "create_fmat3x4", 12, [](uint64_t iterations)
+      {
+        for (uint64_t i = 0; i < iterations; ++i) Bench::Keep(uint64_t(CreateFMat3x4Property().get() != nullptr));
+      });
+    bench.Run("property", "create_buffer", 1024, [](uint64_t iterations)
+      {
+        std::vector<uint8_t> data(1024, 1);
+        for (uint64_t i = 0; i < iterations; ++i) Bench::Keep(uint64_t(CreateBufferProperty(data.data(), 1, 1024).get() != nullptr));
+      }, 1024);
+
+    const auto vec3 = CreateFVec3Property();
+    bench.Run("convert", "from_to_fvec3", 3, [&vec3](uint64_t iterations)
+      {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+          vec3->FromFVec3(glm::f32vec3(float(i), 1.0f, 2.0f));
+          Bench::Keep(uint64_t(vec3->ToFVec3()[0]));
+        }
+      });
+    const auto mat = CreateFMat3x4Property();
+    bench.Run("convert", "from_to_fmat3x4", 12, [&mat](uint64_t iterations)
+      {
+        auto value = glm::f32mat3x4(1.0f);
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+          value[0][3] = float(i);
+          mat->FromFMat3x4(value);
+          Bench::Keep(uint64_t(mat->ToFMat3x4()[0][3]));
+        }
+      });
+    const auto uint = CreateUIntProperty();
+    bench.Run("convert", "from_to_uint", 1, [&uint](uint64_t iterations)
+      {
+        for (uint64_t i = 0; i < iterations; ++i)
+        {
+          uint->FromUInt(uint32_t(i));
+          Bench::Keep(uint->ToUInt());
+        }
+      });
+
+    for (const auto count : { 16u, 1024u })
+    {
+      const auto object = MakeObject(count);
+      std::vector<std::string> keys(count);
+      for (uint32_t i = 0; i < count; ++i) keys[i] = "item_" + std::to_string((i * 7919u) % count);
+      bench.Run("lookup", "object_item", count, [&object, &keys](uint64_t iterations)
+        {
+          for (uint64_t i = 0; i < iterations; ++i) Bench::Keep(object->GetObjectItem(keys[i % keys.size()])->GetUint());
+        });
+    }
+    {
+      auto instances = MakeInstances(1024);
+      const auto array = CreateInstanceProperty(instances);
+      bench.Run("lookup", "array_item", 1024, [&array](uint64_t iterations)
+        {
+          for (uint64_t i = 0; i < iterations; ++i) Bench::Keep(uint64_t(array->GetArrayItem(uint32_t((i * 7919u) % 1024))->GetObjectItems().size()));
+        });
+    }
+
+    // about 10 KiB of nodes per instance, so 10^5 and up only run with --large
+    std::vector<uint32_t> counts{ 1000, 10000 };
+    if (bench.IsLarge()) counts.insert(counts.end(), { 100000, 1000000 });
+    for (const auto count : counts)
+    {
+      auto instances = MakeInstances(count);
+      std::shared_ptr<Property> last;
+      const auto result = bench.Run("instances", "create_instance_property", count, [&instances, &last](uint64_t iterations)
+        {
+          for (uint64_t i = 0; i < iterations; ++i)
+          {
+            last.reset();
+            last = CreateInstanceProperty(instances);
+          }
+        });
+      if (result)
+      {
+        const auto memory = Property::GetMemory(last);
+        result->counters["nodes"] = double(memory.GetNodes());
+        result->counters["bytes"] = double(memory.GetTotal());
+      }
+    }
+
+    for (const auto count : { 1000u, 10000u })
+    {
+      if (!bench.IsSelected("json", "to_json") && !bench.IsSelected("json", "from_json")) break;
+
+      auto instances = MakeInstances(count);
+      const auto root = CreateInstanceProperty(instances);
+      std::map<std::shared_ptr<Property>, std::string> binaries;
+      const auto json = Property::ToJSON(root, binaries);
+      const auto size = json.dump().size();
+
+      bench.Run("json", "to_json", count, [&root](uint64_t iterations)
+        {
+          for (uint64_t i = 0; i < iterations; ++i)
+          {
+            std::map<std::shared_ptr<Property>, std::string> binaries;
+            Bench::Keep(Property::ToJSON(root, binaries).size());
+          }
+        }, size);
+      bench.Run("json", "from_json", count, [&json](uint64_t iterations)
+        {
+          for (uint64_t i = 0; i < iterations; ++i)
+          {
+            std::map<std::shared_ptr<Property>, std::string> binaries;
+            Bench::Keep(Property::FromJSON(json, binaries)->GetArraySize());
+          }
+        }, size);
+    }
+  }
+}
@@ -0,0 +1,161 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "bench.h"
+
+#include <thread>
+#include <random>
+
+namespace RayGene3D
+{
+  namespace
+  {
+    std::shared_ptr<Property> MakeRaw(uint32_t size, const Raw::Policy* policy = nullptr)
+    {
+      const auto raw = std::shared_ptr<Property>(new Property(Property::TYPE_RAW));
+      if (policy) raw->SetRawPolicy(*policy);
+      raw->RawAllocate(size);
+      return raw;
+    }
+  }
+
+  void RunRawBench(Bench& bench)
+  {
+    for (const auto size : { 64u, 4096u, 256u << 10, 16u << 20 })
+    {
+      const auto raw = MakeRaw(size);
+      std::vector<uint8_t> data(size, 3);
+
+      bench.Run("raw", "set_bytes", size, [&raw, &data](uint64_t iterations)
+        {
+          for (uint64_t i = 0; i < iterations; ++i) raw->SetRawBytes({ data.data(), uint32_t(data.size()) }, 0);
+        }, size);
+      bench.Run("raw", "get_bytes", size, [&raw, &data](uint64_t iterations)
+        {
+          for (uint64_t i = 0; i < iterations; ++i)
+          {
+            const auto [bytes, count] = raw->GetRawBytes(0, uint32_t(data.size()));
+            std::memcpy(data.data(), bytes, count);
+          }
+          Bench::Keep(data[0]);
+        }, size);
+    }
+
+    // Streaming and random traversal of large raws under each allocation
+    // policy. The payloads are filled by one thread, as a loader would, and
+    // read by all.
+    if (!bench.IsSuiteSelected("raw_policy"))
+    {
+      return;
+    }
+
+    const auto chunk = size_t(64) << 20;
+    const auto count = bench.IsLarge() ? size_t(16) : size_t(4);
+    const auto threads = std::max(1u, std::thread::hardware_concurrency());
+
+    struct Config
+    {
+      const char* name;
+      Raw::Policy policy;
+    };
+    std::vector<Config> configs(5);
+    configs[0].name = "heap";
+    configs[1].name = "transparent_huge_pages";
+    configs[1].policy.pages = Raw::PAGES_TRANSPARENT;
+    configs[2].name = "explicit_huge_pages";
+    configs[2].policy.pages = Raw::PAGES_EXPLICIT;
+    configs[3].name = "node_0";
+    configs[3].policy.node = 0;
+    configs[4].name = "interleave_thp";
+    configs[4].policy.interleave = true;
+    configs[4].policy.pages = Raw::PAGES_TRANSPARENT;
+
+    std::vector<uint8_t> source(chunk);
+    for (size_t i = 0; i < source.size(); ++i) source[i] = uint8_t(i * 31);
+
+    for (const auto& config : configs)
+    {
+      std::vector<std::shared_ptr<Property>> raws(count);
+      for (auto& raw : raws)
+      {
+        raw = MakeRaw(uint32_t(chunk), &config.policy);
+        raw->SetRawBytes({ source.data(), uint32_t(chunk) }, 0);
+      }
+
+      // one operation is a pass of every thread over all raws
+      const auto run_fn = [&raws, threads](const std::function<uint64_t(const uint64_t*, size_t)>& visit_fn)
+      {
+        return [&raws, threads, visit_fn](uint64_t iterations)
+        {
+          std::vector<std::thread> workers(threads);
+          for (uint32_t t = 0; t < threads; ++t)
+          {
+            workers[t] = std::thread([&raws, &visit_fn, iterations, threads, t]()
+              {
+                uint64_t sum = 0;
+                for (uint64_t i = 0; i < iterations; ++i)
+                {
+                  for (size_t j = 0; j < raws.size(); ++j)
+                  {
+                    const auto [bytes, size] = raws[(j + t) % raws.size()]->GetRawBytes(0);
+                    sum += visit_fn(reinterpret_cast<const uint64_t*>(bytes), size / sizeof(uint64_t));
+                  }
+                }
+                Bench::Keep(sum);
+              });
+          }
+          for (auto& worker : workers) worker.join();
+        };
+      };
+
+      const auto stream = bench.Run("raw_policy", std::string("stream_") + config.name, uint64_t(count * chunk), run_fn([](const uint64_t* items, size_t size)
+        {
+          uint64_t sum = 0;
+          for (size_t i = 0; i < size; ++i) sum += items[i];
+          return sum;
+        }), uint64_t(count * chunk * threads));
+
+      const auto gathers = size_t(1) << 18;
+      const auto gather = bench.Run("raw_policy", std::string("gather_") + config.name, uint64_t(count * gathers), run_fn([gathers](const uint64_t* items, size_t size)
+        {
+          uint64_t sum = 0;
+          std::minstd_rand engine{ uint32_t(size) };
+          for (size_t i = 0; i < gathers; ++i) sum += items[engine() % size];
+          return sum;
+        }));
+
+      for (const auto result : { stream, gather })
+      {
+        if (!result) continue;
+        result->counters["mapped"] = raws[0]->IsRawMapped() ? 1.0 : 0.0;
+        result->counters["threads"] = double(threads);
+      }
+    }
+  }
+}
@@ -0,0 +1,197 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "test.h"
+#include "../util/compression.h"
+
+#include <cstring>
+#include <random>
+
+namespace RayGene3D
+{
+  namespace
+  {
+    void MakeGrid(uint32_t size, std::vector<Vertex>& vertices, std::vector<Triangle>& triangles)
+    {
+      for (uint32_t y = 0; y < size; ++y)
+      {
+        for (uint32_t x = 0; x < size; ++x)
+        {
+          Vertex vertex;
+          vertex.pos = { x * 0.1f, float((x * 7 + y * 3) % 11) * 0.01f, y * 0.1f };
+          vertex.nrm = { 0.0f, 1.0f, 0.0f };
+          vertex.tng = { 1.0f, 0.0f, 0.0f };
+          vertex.sgn = 1.0f;
+          vertex.tc0 = { x / float(size), y / float(size) };
+          vertex.tc1 = vertex.tc0;
+          vertices.push_back(vertex);
+        }
+      }
+
+      for (uint32_t y = 0; y + 1 < size; ++y)
+      {
+        for (uint32_t x = 0; x + 1 < size; ++x)
+        {
+          const auto i = y * size + x;
+          Triangle first;
+          first.idx = { i, i + 1, i + size };
+          triangles.push_back(first);
+          Triangle second;
+          second.idx = { i + 1, i + size + 1, i + size };
+          triangles.push_back(second);
+        }
+      }
+    }
+  }
+
+  void RunCodecTest(Test& test)
+  {
+    test.SetSuite("codec");
+
+    std::mt19937 random(1);
+
+    // LZ4 blocks, random and repetitive input
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+      std::vector<uint8_t> data(random() % 70000);
+      for (size_t j = 0; j < data.size(); ++j) data[j] = i % 2 ? uint8_t(random()) : uint8_t((j / 7) & 3);
+
+      std::vector<uint8_t> packed(CompressBound(uint32_t(data.size())));
+      const auto size = CompressBlock(data.data(), uint32_t(data.size()), packed.data(), uint32_t(packed.size()));
+      std::vector<uint8_t> unpacked(data.size());
+      RAYGENE3D_CHECK(test, DecompressBlock(packed.data(), size, unpacked.data(), uint32_t(unpacked.size())));
+      RAYGENE3D_CHECK(test, unpacked == data);
+
+      // flipped bits may decode to other bytes, but never out of bounds
+      if (size > 0)
+      {
+        packed[random() % size] ^= uint8_t(1u << (random() % 8));
+        DecompressBlock(packed.data(), size, unpacked.data(), uint32_t(unpacked.size()));
+      }
+    }
+
+    std::vector<Vertex> vertices;
+    std::vector<Triangle> triangles;
+    MakeGrid(64, vertices, triangles);
+    const std::pair<const void*, uint32_t> vertex_bytes = { vertices.data(), uint32_t(vertices.size() * sizeof(Vertex)) };
+    const std::pair<const void*, uint32_t> triangle_bytes = { triangles.data(), uint32_t(triangles.size() * sizeof(Triangle)) };
+
+    // streams round-trip at any count, partial vertex groups and multi-byte index codes included
+    for (const auto count : { 0u, 1u, 15u, 17u, 1003u })
+    {
+      std::vector<Vertex> decoded(count);
+      const auto encoded = EncodeVertices(vertices.data(), count, 0, 0);
+      RAYGENE3D_CHECK(test, DecodeVertices({ encoded.data(), uint32_t(encoded.size()) }, decoded.data(), count));
+      RAYGENE3D_CHECK(test, count == 0 || std::memcmp(decoded.data(), vertices.data(), count * sizeof(Vertex)) == 0);
+
+      std::vector<Triangle> scattered(count);
+      for (auto& triangle : scattered) triangle.idx = { uint32_t(random()), uint32_t(random() % 64), uint32_t(random() % 100000) };
+      std::vector<Triangle> indices(count);
+      const auto packed = EncodeTriangles(scattered.data(), count);
+      RAYGENE3D_CHECK(test, DecodeTriangles({ packed.data(), uint32_t(packed.size()) }, indices.data(), count));
+      RAYGENE3D_CHECK(test, count == 0 || std::memcmp(indices.data(), scattered.data(), count * sizeof(Triangle)) == 0);
+    }
+
+    // geometry containers are lossless without quantisation
+    {
+      std::vector<uint8_t> raw;
+      const auto packed = CompressGeometry(vertex_bytes, Raw::LAYOUT_VERTEX, 1u << 16, 0, 0);
+      RAYGENE3D_CHECK(test, IsCompressedGeometry({ packed.data(), uint32_t(packed.size()) }));
+      RAYGENE3D_CHECK(test, DecompressGeometry({ packed.data(), uint32_t(packed.size()) }, raw) == Raw::LAYOUT_VERTEX);
+      RAYGENE3D_CHECK(test, raw.size() == vertex_bytes.second && std::memcmp(raw.data(), vertices.data(), raw.size()) == 0);
+    }
+    {
+      std::vector<uint8_t> raw;
+      const auto packed = CompressGeometry(triangle_bytes, Raw::LAYOUT_TRIANGLE, 1u << 16, 0, 0);
+      RAYGENE3D_CHECK(test, DecompressGeometry({ packed.data(), uint32_t(packed.size()) }, raw) == Raw::LAYOUT_TRIANGLE);
+      RAYGENE3D_CHECK(test, raw.size() == triangle_bytes.second && std::memcmp(raw.data(), triangles.data(), raw.size()) == 0);
+    }
+
+    // chunks decode on demand through a raw source, any range alone
+    const auto chunked = CompressChunks(vertex_bytes, 4096);
+    RAYGENE3D_CHECK(test, IsCompressedChunks({ chunked.data(), uint32_t(chunked.size()) }));
+    {
+      const auto raw = std::shared_ptr<Property>(new Property(Property::TYPE_RAW));
+      raw->SetRawSource(std::make_shared<ChunkSource>(std::vector<uint8_t>(chunked)));
+      const auto part = raw->GetTypedBytes<Vertex>(1000, 10);
+      RAYGENE3D_CHECK(test, std::memcmp(part.first, vertices.data() + 1000, 10 * sizeof(Vertex)) == 0);
+      const auto all = raw->GetRawBytes(0);
+      RAYGENE3D_CHECK(test, all.second == vertex_bytes.second && std::memcmp(all.first, vertices.data(), all.second) == 0);
+    }
+
+    // a damaged header or offset table is rejected up front or fails to decode
+    uint32_t decoded = 0;
+    for (uint32_t i = 0; i < 300; ++i)
+    {
+      auto damaged = chunked;
+      if (i % 3 == 0) damaged.resize(random() % damaged.size());
+      else damaged[random() % std::min<size_t>(damaged.size(), 256)] ^= uint8_t(1u << (random() % 8));
+
+      if (!IsCompressedChunks({ damaged.data(), uint32_t(damaged.size()) })) continue;
+      try
+      {
+        ChunkSource source(std::move(damaged));
+        std::vector<uint8_t> raw(source.GetSize());
+        source.Fetch(raw.data(), 0, uint32_t(raw.size()));
+        decoded += std::memcmp(raw.data(), vertices.data(), std::min<size_t>(raw.size(), vertex_bytes.second)) != 0;
+      }
+      catch (const std::exception&)
+      {
+      }
+    }
+    RAYGENE3D_CHECK(test, decoded == 0);
+
+    {
+      auto packed = CompressGeometry(triangle_bytes, Raw::LAYOUT_TRIANGLE, 1u << 16, 0, 0);
+      packed.resize(packed.size() / 2);
+      bool failed = !IsCompressedGeometry({ packed.data(), uint32_t(packed.size()) });
+      if (!failed)
+      {
+        std::vector<uint8_t> raw;
+        try { DecompressGeometry({ packed.data(), uint32_t(packed.size()) }, raw); }
+        catch (const std::exception&) { failed = true; }
+      }
+      RAYGENE3D_CHECK(test, failed);
+    }
+
+    // a header disagreeing with the encoded streams is rejected before the raw is allocated
+    const auto packed = CompressGeometry(triangle_bytes, Raw::LAYOUT_TRIANGLE, 1u << 16, 0, 0);
+    for (const auto& [offset, value] : std::vector<std::pair<uint32_t, uint32_t>>{ { 4, Raw::LAYOUT_VERTEX }, { 4, 7 }, { 8, 0xfffffff4 }, { 8, triangle_bytes.second + 1 }, { 8, triangle_bytes.second - 12 } })
+    {
+      auto damaged = packed;
+      std::memcpy(damaged.data() + offset, &value, sizeof(value));
+
+      std::vector<uint8_t> raw;
+      bool failed = false;
+      try { DecompressGeometry({ damaged.data(), uint32_t(damaged.size()) }, raw); }
+      catch (const std::exception&) { failed = true; }
+      RAYGENE3D_CHECK(test, failed && raw.capacity() == 0);
+    }
+  }
+}
@@ -0,0 +1,99 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "test.h"
+
+#include <thread>
+
+namespace RayGene3D
+{
+  void RunJobTest(Test& test)
+  {
+    test.SetSuite("job");
+
+    JobSystem jobs;
+    jobs.Start(3);
+
+    std::vector<uint32_t> values(10000);
+    jobs.ParallelFor(0, uint32_t(values.size()), 64, [&values](uint32_t begin, uint32_t end)
+      {
+        for (auto i = begin; i < end; ++i) values[i] = i;
+      });
+    const auto sum = jobs.ParallelReduce(0, uint32_t(values.size()), 100, uint64_t(0),
+      [&values](uint32_t begin, uint32_t end) { uint64_t partial = 0; for (auto i = begin; i < end; ++i) partial += values[i]; return partial; },
+      [](uint64_t a, uint64_t b) { return a + b; });
+    RAYGENE3D_CHECK(test, sum == uint64_t(values.size()) * (values.size() - 1) / 2);
+
+    // nested groups, each waiter helps with its own tasks
+    std::atomic<uint32_t> nested{ 0 };
+    jobs.ParallelFor(0, 16, 1, [&jobs, &nested](uint32_t, uint32_t)
+      {
+        jobs.ParallelFor(0, 16, 1, [&nested](uint32_t, uint32_t) { nested += 1; });
+      });
+    RAYGENE3D_CHECK(test, nested == 256);
+
+    // a waiter never runs unrelated work, which may take a lock it holds
+    std::atomic<bool> holding{ true };
+    std::atomic<bool> on_holder{ false };
+    const auto holder = std::this_thread::get_id();
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+      jobs.Submit([&holding, &on_holder, holder]() { if (holding && std::this_thread::get_id() == holder) on_holder = true; });
+    }
+    jobs.ParallelFor(0, 256, 1, [](uint32_t, uint32_t) { std::this_thread::yield(); });
+    holding = false;
+    RAYGENE3D_CHECK(test, !on_holder);
+
+    bool thrown = false;
+    try
+    {
+      JobSystem::Group group(jobs);
+      group.Run([]() { throw std::runtime_error("task failed"); });
+      group.Wait();
+    }
+    catch (const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    RAYGENE3D_CHECK(test, thrown);
+
+    jobs.Stop();
+    thrown = false;
+    try { jobs.Submit([]() {}); }
+    catch (const std::runtime_error&) { thrown = true; }
+    RAYGENE3D_CHECK(test, thrown);
+
+    // without a pool, For runs on temporary threads
+    std::vector<std::atomic<uint32_t>> visits(1000);
+    JobSystem::For(uint32_t(visits.size()), [&visits](uint32_t i) { visits[i] += 1; });
+    uint32_t once = 0;
+    for (const auto& visit : visits) once += visit == 1;
+    RAYGENE3D_CHECK(test, once == visits.size());
+  }
+}
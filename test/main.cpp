@@ -0,0 +1,64 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "test.h"
+
+#include <cstdio>
+#include <filesystem>
+
+using namespace RayGene3D;
+
+void Test::Check(bool condition, const char* expression, const char* file, int line)
+{
+  checks += 1;
+  if (condition) return;
+
+  failures += 1;
+  std::fprintf(stderr, "%s: %s:%d: check failed: %s\n", suite.c_str(), file, line, expression);
+}
+
+// usage: raygene3d-util-test
+// Runs in the working directory, local storage writes into its "cache" folder.
+int main()
+{
+  std::error_code error;
+  std::filesystem::create_directories("cache", error);
+
+  Test test;
+  RunCodecTest(test);
+  RunJobTest(test);
+  RunMemoryTest(test);
+  RunPropertyTest(test);
+  RunRawTest(test);
+  RunSlotMapTest(test);
+  RunStorageTest(test);
+
+  std::printf("%u checks, %u failed\n", test.GetChecks(), test.GetFailures());
+  return test.GetFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "test.h"
+
+namespace RayGene3D
+{
+  namespace
+  {
+    template<typename T>
+    std::shared_ptr<Property> MakeValue(Property::Type type, const T& value)
+    {
+      const auto property = std::shared_ptr<Property>(new Property(type));
+      if constexpr (std::is_same<T, uint32_t>::value) property->SetUint(value);
+      else property->SetString(value);
+      return property;
+    }
+
+    // instances referencing one of a few meshes, with a transform and a name each
+    std::shared_ptr<Property> MakeInstances(uint32_t count, const std::string& name, const std::shared_ptr<Property>& mesh)
+    {
+      const std::vector<float> transform(16, 1.0f);
+      const auto instances = std::shared_ptr<Property>(new Property(Property::TYPE_ARRAY));
+      instances->SetArraySize(count);
+      for (uint32_t i = 0; i < count; ++i)
+      {
+        const auto instance = std::shared_ptr<Property>(new Property(Property::TYPE_OBJECT));
+        instance->SetObjectItem("transform", CreateBufferProperty(transform.data(), uint32_t(sizeof(float)), uint32_t(transform.size())));
+        instance->SetObjectItem("mesh", MakeValue(Property::TYPE_UINT, i % 4));
+        instance->SetObjectItem("name", MakeValue(Property::TYPE_STRING, name));
+        instances->SetArrayItem(i, instance);
+      }
+
+      const auto root = std::shared_ptr<Property>(new Property(Property::TYPE_OBJECT));
+      root->SetObjectItem("instances", instances);
+      root->SetObjectItem("mesh", mesh);
+      root->SetObjectItem("alias", mesh);
+      return root;
+    }
+  }
+
+  void RunMemoryTest(Test& test)
+  {
+    test.SetSuite("memory");
+
+    const uint32_t count = 100;
+    const std::vector<uint8_t> bytes(1u << 20, 1);
+    const auto before = Property::GetMemory();
+    {
+      const auto mesh = CreateBufferProperty(bytes.data(), 1, uint32_t(bytes.size()));
+      const auto root = MakeInstances(count, "instance", mesh);
+
+      // the mesh reached twice is counted once
+      const auto memory = Property::GetMemory(root);
+      RAYGENE3D_CHECK(test, memory.nodes[Property::TYPE_OBJECT] == 1 + count);
+      RAYGENE3D_CHECK(test, memory.nodes[Property::TYPE_ARRAY] == 1);
+      RAYGENE3D_CHECK(test, memory.nodes[Property::TYPE_UINT] == count);
+      RAYGENE3D_CHECK(test, memory.nodes[Property::TYPE_STRING] == count);
+      RAYGENE3D_CHECK(test, memory.nodes[Property::TYPE_RAW] == count + 1);
+      RAYGENE3D_CHECK(test, memory.GetNodes() == 4 * count + 3);
+      RAYGENE3D_CHECK(test, memory.raw_bytes == count * 16 * sizeof(float) + bytes.size());
+      RAYGENE3D_CHECK(test, memory.node_bytes == memory.GetNodes() * sizeof(Property));
+      RAYGENE3D_CHECK(test, memory.control_bytes == memory.GetNodes() * (2 * sizeof(void*) + 2 * sizeof(uint32_t)));
+      RAYGENE3D_CHECK(test, memory.container_bytes >= count * sizeof(std::shared_ptr<Property>));
+
+      // short names and keys stay in the small string buffer
+      RAYGENE3D_CHECK(test, memory.string_bytes == 0);
+      const std::string long_name(100, 'x');
+      const auto named = MakeInstances(count, long_name, mesh);
+      RAYGENE3D_CHECK(test, Property::GetMemory(named).string_bytes >= count * (long_name.size() + 1));
+
+      // the process-wide counters follow construction and destruction
+      const auto live = Property::GetMemory();
+      RAYGENE3D_CHECK(test, live.nodes[Property::TYPE_OBJECT] - before.nodes[Property::TYPE_OBJECT] == 2 * (1 + count));
+      RAYGENE3D_CHECK(test, live.nodes[Property::TYPE_RAW] - before.nodes[Property::TYPE_RAW] == 2 * count + 1);
+      RAYGENE3D_CHECK(test, live.string_bytes - before.string_bytes >= count * (long_name.size() + 1));
+
+      // largest first: the whole tree, the mesh under the first key reaching
+      // it, then the instance paths
+      const auto top = Property::GetMemoryTop(root, 4);
+      RAYGENE3D_CHECK(test, top.size() == 4);
+      if (top.size() == 4)
+      {
+        RAYGENE3D_CHECK(test, top[0].path.empty() && top[0].bytes == memory.GetTotal());
+        RAYGENE3D_CHECK(test, top[1].path == "alias" && top[1].bytes >= bytes.size());
+        RAYGENE3D_CHECK(test, top[2].path == "instances" && top[3].path == "instances/*");
+        RAYGENE3D_CHECK(test, top[3].nodes == count);
+        for (size_t i = 1; i < top.size(); ++i) RAYGENE3D_CHECK(test, top[i - 1].bytes >= top[i].bytes);
+      }
+    }
+
+    const auto after = Property::GetMemory();
+    for (uint32_t i = 0; i <= Property::TYPE_RAW; ++i) RAYGENE3D_CHECK(test, after.nodes[i] == before.nodes[i]);
+    RAYGENE3D_CHECK(test, after.string_bytes == before.string_bytes);
+  }
+}
@@ -0,0 +1,240 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "test.h"
+#include "../util/concurrent_tree.h"
+
+#include <thread>
+
+namespace RayGene3D
+{
+  namespace
+  {
+    std::shared_ptr<Property> MakeUint(uint32_t value)
+    {
+      const auto property = std::shared_ptr<Property>(new Property(Property::TYPE_UINT));
+      property->SetUint(value);
+      return property;
+    }
+
+    std::shared_ptr<Property> MakeScene(uint32_t count)
+    {
+      const auto nodes = std::shared_ptr<Property>(new Property(Property::TYPE_ARRAY));
+      nodes->SetArraySize(count);
+      for (uint32_t i = 0; i < count; ++i)
+      {
+        const std::vector<uint8_t> bytes(256, uint8_t(i));
+        const auto node = std::shared_ptr<Property>(new Property(Property::TYPE_OBJECT));
+        node->SetObjectItem("value", MakeUint(i));
+        node->SetObjectItem("raw", CreateBufferProperty(bytes.data(), 1, uint32_t(bytes.size())));
+        nodes->SetArrayItem(i, node);
+      }
+
+      const auto root = std::shared_ptr<Property>(new Property(Property::TYPE_OBJECT));
+      root->SetObjectItem("nodes", nodes);
+      return root;
+    }
+
+    std::shared_ptr<Property> GetValue(const std::shared_ptr<Property>& root, uint32_t index)
+    {
+      return root->GetObjectItem("nodes")->GetArrayItem(index)->GetObjectItem("value");
+    }
+  }
+
+  void RunPropertyTest(Test& test)
+  {
+    test.SetSuite("property");
+
+    // a snapshot keeps its state while the live tree is edited
+    {
+      const auto scene = MakeScene(32);
+      const auto snapshot = Property::Snapshot(scene);
+      const auto hash = snapshot->GetHash();
+      Property::Edit(scene, "nodes/3/value")->SetUint(77);
+      Property::Edit(scene, "")->SetObjectItem("extra", MakeUint(5));
+      RAYGENE3D_CHECK(test, snapshot->GetHash() == hash);
+      RAYGENE3D_CHECK(test, GetValue(snapshot, 3)->GetUint() == 3);
+      RAYGENE3D_CHECK(test, GetValue(scene, 3)->GetUint() == 77);
+      RAYGENE3D_CHECK(test, !snapshot->HasObjectItem("extra") && scene->HasObjectItem("extra"));
+    }
+
+    // plain setters refuse nodes shared with a snapshot, the edited path is private again
+    {
+      const auto scene = MakeScene(8);
+      const auto snapshot = Property::Snapshot(scene);
+
+      auto refused = false;
+      try { GetValue(scene, 5)->SetUint(1000); } catch (const std::runtime_error&) { refused = true; }
+      RAYGENE3D_CHECK(test, refused);
+      RAYGENE3D_CHECK(test, GetValue(snapshot, 5)->GetUint() == 5);
+
+      refused = false;
+      const uint8_t bytes[3] = { 1, 2, 3 };
+      try { scene->GetObjectItem("nodes")->GetArrayItem(5)->GetObjectItem("raw")->SetRawBytes({ bytes, 3 }, 0); } catch (const std::runtime_error&) { refused = true; }
+      RAYGENE3D_CHECK(test, refused);
+
+      const auto value = Property::Edit(scene, "nodes/5/value");
+      value->SetUint(1000);
+      value->SetUint(1001);
+      RAYGENE3D_CHECK(test, GetValue(scene, 5)->GetUint() == 1001 && GetValue(snapshot, 5)->GetUint() == 5);
+      RAYGENE3D_CHECK(test, Property::Edit(scene, "nodes/5/value") == value);
+
+      // siblings of the edited path are still shared
+      refused = false;
+      try { GetValue(scene, 6)->SetUint(1000); } catch (const std::runtime_error&) { refused = true; }
+      RAYGENE3D_CHECK(test, refused);
+
+      // the next snapshot shares the copies made since the previous one
+      const auto later = Property::Snapshot(scene);
+      refused = false;
+      try { value->SetUint(1002); } catch (const std::runtime_error&) { refused = true; }
+      RAYGENE3D_CHECK(test, refused);
+      RAYGENE3D_CHECK(test, GetValue(later, 5)->GetUint() == 1001);
+    }
+
+    // a reconcile copies the shared nodes it changes
+    {
+      const auto scene = MakeScene(4);
+      const auto snapshot = Property::Snapshot(scene);
+      const auto hash = snapshot->GetHash();
+
+      std::map<std::shared_ptr<Property>, std::string> binaries;
+      auto json = Property::ToJSON(snapshot, binaries);
+      json["nodes"][2]["value"] = 42u;
+      Property::Summary summary;
+      Property::Reconcile(json, scene, binaries, summary);
+      RAYGENE3D_CHECK(test, summary.updated == 1);
+      RAYGENE3D_CHECK(test, GetValue(scene, 2)->GetUint() == 42 && GetValue(snapshot, 2)->GetUint() == 2);
+      RAYGENE3D_CHECK(test, snapshot->GetHash() == hash);
+    }
+
+    // a diff names the changed paths, applying it reproduces the newer tree
+    {
+      const auto scene = MakeScene(32);
+      const auto copy = MakeScene(32);
+      RAYGENE3D_CHECK(test, scene->GetHash() == copy->GetHash());
+      RAYGENE3D_CHECK(test, Property::Diff(scene, copy).empty());
+
+      // deep writes through plain accessors must reach the cached container hashes
+      GetValue(scene, 7)->SetUint(1000);
+      {
+        const auto patch = Property::Diff(copy, scene);
+        RAYGENE3D_CHECK(test, patch.size() == 1 && patch[0].path == "nodes/7/value");
+        RAYGENE3D_CHECK(test, Property::Apply(copy, patch)->GetHash() == scene->GetHash());
+      }
+
+      // the copy was patched in place, so only the dirty raw range differs now
+      const uint8_t bytes[3] = { 1, 2, 3 };
+      scene->GetObjectItem("nodes")->GetArrayItem(9)->GetObjectItem("raw")->SetRawBytes({ bytes, 3 }, 100);
+      {
+        const auto patch = Property::Diff(copy, scene);
+        RAYGENE3D_CHECK(test, patch.size() == 1 && patch[0].operation == Property::OPERATION_BYTES && patch[0].path == "nodes/9/raw");
+        RAYGENE3D_CHECK(test, Property::Diff(Property::Apply(copy, patch), scene).empty());
+      }
+
+      // removals and resizes come back as their own operations
+      Property::Edit(scene, "nodes/2")->RemoveObjectItem("value");
+      Property::Edit(scene, "nodes")->SetArraySize(30);
+      {
+        const auto patch = Property::Diff(copy, scene);
+        RAYGENE3D_CHECK(test, patch.size() == 2);
+        RAYGENE3D_CHECK(test, Property::Diff(Property::Apply(copy, patch), scene).empty());
+      }
+    }
+
+    // the diff of a snapshot against its live tree covers the edits since
+    {
+      const auto scene = MakeScene(16);
+      const auto snapshot = Property::Snapshot(scene);
+      Property::Edit(scene, "nodes/3/value")->SetUint(77);
+      Property::Edit(scene, "")->SetObjectItem("extra", MakeUint(5));
+
+      const auto patch = Property::Diff(snapshot, scene);
+      RAYGENE3D_CHECK(test, patch.size() == 2);
+      RAYGENE3D_CHECK(test, Property::Apply(snapshot, patch)->GetHash() == scene->GetHash());
+    }
+
+    // readers of a concurrent tree see every commit whole, in-place stores as they land
+    {
+      const auto root = std::shared_ptr<Property>(new Property(Property::TYPE_OBJECT));
+      const auto pair = std::shared_ptr<Property>(new Property(Property::TYPE_OBJECT));
+      pair->SetObjectItem("a", MakeUint(0));
+      pair->SetObjectItem("b", MakeUint(0));
+      root->SetObjectItem("pair", pair);
+      root->SetObjectItem("counter", MakeUint(0));
+
+      ConcurrentTree tree(root, 8);
+      {
+        // a reader pinned before a commit keeps the old root alive
+        const auto pinned = tree.Read();
+        const auto edited = tree.Edit("pair");
+        edited->SetObjectItem("a", MakeUint(1));
+        edited->SetObjectItem("b", MakeUint(1));
+        tree.Commit();
+        RAYGENE3D_CHECK(test, pinned->GetObjectItem("pair")->GetObjectItem("a")->GetUint() == 0);
+        RAYGENE3D_CHECK(test, tree.Read()->GetObjectItem("pair")->GetObjectItem("a")->GetUint() == 1);
+        RAYGENE3D_CHECK(test, tree.GetRetired() == 1);
+      }
+      tree.Reclaim();
+      RAYGENE3D_CHECK(test, tree.GetRetired() == 0);
+
+      std::atomic<bool> done{ false };
+      std::atomic<uint32_t> mismatches{ 0 };
+      std::vector<std::thread> readers(3);
+      for (auto& reader : readers)
+      {
+        reader = std::thread([&tree, &done, &mismatches]()
+          {
+            uint32_t last = 0;
+            while (!done)
+            {
+              const auto view = tree.Read();
+              const auto& items = view->GetObjectItem("pair");
+              const auto counter = view->GetObjectItem("counter")->LoadUint();
+              if (items->GetObjectItem("a")->GetUint() != items->GetObjectItem("b")->GetUint() || counter < last) mismatches += 1;
+              last = counter;
+            }
+          });
+      }
+
+      for (uint32_t i = 2; i < 2000; ++i)
+      {
+        tree.GetRoot()->GetObjectItem("counter")->StoreUint(i);
+        const auto edited = tree.Edit("pair");
+        edited->SetObjectItem("a", MakeUint(i));
+        edited->SetObjectItem("b", MakeUint(i));
+        tree.Commit();
+      }
+      done = true;
+      for (auto& reader : readers) reader.join();
+      RAYGENE3D_CHECK(test, mismatches == 0);
+      RAYGENE3D_CHECK(test, tree.Read()->GetObjectItem("pair")->GetObjectItem("b")->GetUint() == 1999);
+    }
+  }
+}
@@ -0,0 +1,142 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "test.h"
+#include "../util/staging.h"
+
+#include <cstring>
+#include <thread>
+
+namespace RayGene3D
+{
+  void RunRawTest(Test& test)
+  {
+    test.SetSuite("raw");
+
+    // small writes are packed into the arena and copied to their raws on Apply
+    {
+      const std::vector<uint8_t> zeros(1024, 0);
+      const auto target = CreateBufferProperty(zeros.data(), 1, uint32_t(zeros.size()));
+
+      Staging staging(256, 16);
+      const uint8_t bytes[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+      RAYGENE3D_CHECK(test, staging.Enqueue(target, 0, { bytes, 3 }));
+      RAYGENE3D_CHECK(test, staging.Enqueue(target, 3, { bytes + 3, 3 }));
+      RAYGENE3D_CHECK(test, staging.Enqueue(target, 100, { bytes, 5 }));
+      RAYGENE3D_CHECK(test, staging.GetCommands().size() == 2);
+      RAYGENE3D_CHECK(test, staging.GetCommands()[0].size == 6 && staging.GetCommands()[1].src_offset % 16 == 0);
+
+      RAYGENE3D_CHECK(test, staging.Apply() == 11);
+      RAYGENE3D_CHECK(test, staging.GetCommands().empty() && staging.GetInflight() == 1);
+      const auto written = static_cast<const uint8_t*>(target->GetRawBytes(0).first);
+      RAYGENE3D_CHECK(test, std::memcmp(written, bytes, 6) == 0 && std::memcmp(written + 100, bytes, 5) == 0);
+      RAYGENE3D_CHECK(test, written[6] == 0 && written[99] == 0);
+
+      // a full arena refuses writes until the batch holding the room retires, then wraps around
+      Staging ring(256, 16);
+      const std::vector<uint8_t> block(64, 9);
+      uint32_t accepted = 0;
+      while (ring.Enqueue(target, 128 + accepted * 80, { block.data(), uint32_t(block.size()) }))
+      {
+        accepted += 1;
+        if (accepted == 2) ring.Apply();
+      }
+      RAYGENE3D_CHECK(test, accepted == 4);
+      ring.Apply();
+      RAYGENE3D_CHECK(test, ring.GetInflight() == 2);
+      ring.Retire();
+      RAYGENE3D_CHECK(test, ring.Enqueue(target, 900, { block.data(), uint32_t(block.size()) }));
+      RAYGENE3D_CHECK(test, ring.GetCommands().size() == 1 && ring.GetCommands()[0].src_offset == 0);
+      ring.Apply();
+      ring.Retire();
+      ring.Retire();
+      RAYGENE3D_CHECK(test, ring.GetInflight() == 0);
+      RAYGENE3D_CHECK(test, written[128 + 3 * 80] == 9 && written[900] == 9 && written[963] == 9);
+
+      auto thrown = false;
+      try { staging.Enqueue(target, 1020, { bytes, 8 }); } catch (const std::runtime_error&) { thrown = true; }
+      RAYGENE3D_CHECK(test, thrown);
+    }
+
+    // the reader sees whole publishes only, with every range written since its last copy
+    {
+      BufferedRaw buffered;
+      buffered.Allocate(64);
+
+      const std::vector<uint8_t> ones(64, 1);
+      buffered.SetBytes({ ones.data(), 64 }, 0);
+      buffered.Publish();
+      RAYGENE3D_CHECK(test, static_cast<const uint8_t*>(buffered.Acquire().GetBytes(0).first)[63] == 1);
+
+      const uint8_t two = 2;
+      const uint8_t three = 3;
+      buffered.SetBytes({ &two, 1 }, 10);
+      buffered.Publish();
+      buffered.SetBytes({ &three, 1 }, 20);
+      buffered.Publish();
+      {
+        const auto bytes = static_cast<const uint8_t*>(buffered.Acquire().GetBytes(0).first);
+        RAYGENE3D_CHECK(test, bytes[0] == 1 && bytes[10] == 2 && bytes[20] == 3);
+      }
+
+    }
+
+    // a reader racing the writer never sees a publish half applied
+    {
+      BufferedRaw buffered;
+      buffered.Allocate(64);
+      const std::vector<uint8_t> zeros(64, 0);
+      buffered.SetBytes({ zeros.data(), 64 }, 0);
+      buffered.Publish();
+      buffered.Acquire();
+
+      std::atomic<bool> done{ false };
+      std::thread writer([&buffered, &done]()
+        {
+          for (uint32_t i = 0; i < 2000; ++i)
+          {
+            const std::vector<uint8_t> value(64, uint8_t(i));
+            buffered.SetBytes({ value.data(), 64 }, 0);
+            buffered.Publish();
+          }
+          done = true;
+        });
+
+      uint32_t torn = 0;
+      while (!done)
+      {
+        const auto bytes = static_cast<const uint8_t*>(buffered.Acquire().GetBytes(0).first);
+        for (uint32_t i = 1; i < 64; ++i) torn += bytes[i] != bytes[0];
+      }
+      writer.join();
+      RAYGENE3D_CHECK(test, torn == 0);
+      RAYGENE3D_CHECK(test, static_cast<const uint8_t*>(buffered.Acquire().GetBytes(0).first)[0] == uint8_t(1999));
+    }
+  }
+}
@@ -0,0 +1,64 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "test.h"
+
+namespace RayGene3D
+{
+  void RunSlotMapTest(Test& test)
+  {
+    test.SetSuite("slot_map");
+
+    SlotMap<uint32_t> map;
+    std::vector<SlotMap<uint32_t>::Handle> handles;
+    for (uint32_t i = 0; i < 8; ++i) handles.push_back(map.Insert(i * 10));
+    RAYGENE3D_CHECK(test, map.GetSize() == 8);
+
+    // removal swaps the last value in, handles of the others still find theirs
+    RAYGENE3D_CHECK(test, map.Erase(handles[2]));
+    RAYGENE3D_CHECK(test, !map.Erase(handles[2]));
+    RAYGENE3D_CHECK(test, map.Find(handles[2]) == nullptr && !map.Contains(handles[2]));
+    RAYGENE3D_CHECK(test, map.GetValues()[2] == 70);
+    for (const auto i : { 0u, 1u, 3u, 7u }) RAYGENE3D_CHECK(test, map.Find(handles[i]) && *map.Find(handles[i]) == i * 10);
+
+    // a reused slot gets a new generation, so the stale handle stays dead
+    const auto reused = map.Insert(99);
+    RAYGENE3D_CHECK(test, reused.index == handles[2].index && reused != handles[2]);
+    RAYGENE3D_CHECK(test, map.Find(handles[2]) == nullptr && *map.Find(reused) == 99);
+
+    // compaction keeps every surviving handle valid
+    RAYGENE3D_CHECK(test, map.EraseIf([](uint32_t value) { return value % 20 == 0; }) == 3);
+    RAYGENE3D_CHECK(test, map.GetSize() == 5 && *map.Find(reused) == 99);
+    for (const auto i : { 1u, 3u, 5u, 7u }) RAYGENE3D_CHECK(test, map.Find(handles[i]) && *map.Find(handles[i]) == i * 10);
+    for (uint32_t i = 0; i < map.GetSize(); ++i) RAYGENE3D_CHECK(test, *map.Find(map.GetHandle(i)) == map.GetValues()[i]);
+
+    map.Clear();
+    RAYGENE3D_CHECK(test, map.GetSize() == 0 && map.Find(handles[1]) == nullptr && map.Find(reused) == nullptr);
+  }
+}
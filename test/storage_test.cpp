@@ -0,0 +1,309 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "test.h"
+#include "../util/storage/local_storage.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <thread>
+
+namespace RayGene3D
+{
+  namespace
+  {
+    std::shared_ptr<Property> MakeMesh(uint8_t value, uint32_t size)
+    {
+      const std::vector<uint8_t> bytes(size, value);
+      const auto mesh = std::shared_ptr<Property>(new Property(Property::TYPE_OBJECT));
+      mesh->SetObjectItem("raw", CreateBufferProperty(bytes.data(), 1, uint32_t(bytes.size())));
+      return mesh;
+    }
+
+    bool IsMesh(const std::shared_ptr<Property>& mesh, uint8_t value, uint32_t size)
+    {
+      if (!mesh) return false;
+      const auto [bytes, count] = mesh->GetObjectItem("raw")->GetRawBytes(0);
+      if (count != size) return false;
+      for (uint32_t i = 0; i < count; ++i) if (static_cast<const uint8_t*>(bytes)[i] != value) return false;
+      return true;
+    }
+  }
+
+  void RunStorageTest(Test& test)
+  {
+    test.SetSuite("storage");
+
+    // saves and loads from many threads, on distinct aliases and on one shared alias
+    {
+      LocalStorage storage;
+      storage.Save("test.shared", MakeMesh(0, 4096));
+
+      std::atomic<uint32_t> torn{ 0 };
+      std::vector<std::thread> threads;
+      for (uint32_t t = 0; t < 4; ++t)
+      {
+        threads.emplace_back([&storage, &torn, t]()
+          {
+            const auto alias = "test.thread." + std::to_string(t);
+            for (uint32_t i = 0; i < 20; ++i)
+            {
+              storage.Save(alias, MakeMesh(uint8_t(i), 1024));
+              std::shared_ptr<Property> loaded;
+              storage.Load(alias, loaded);
+              if (!IsMesh(loaded, uint8_t(i), 1024)) torn += 1;
+
+              // writers of the shared alias always write the whole document at once
+              storage.Save("test.shared", MakeMesh(uint8_t(t), 4096));
+              std::shared_ptr<Property> shared;
+              storage.Load("test.shared", shared);
+              const auto value = shared ? *static_cast<const uint8_t*>(shared->GetObjectItem("raw")->GetRawBytes(0).first) : 0xff;
+              if (!IsMesh(shared, value, 4096)) torn += 1;
+            }
+          });
+      }
+      for (auto& thread : threads) thread.join();
+      RAYGENE3D_CHECK(test, torn == 0);
+    }
+
+    // queued requests run by priority, a cancelled one never calls back
+    {
+      LocalStorage storage;
+      storage.SetWorkerCount(1);
+
+      std::promise<void> started;
+      std::promise<void> release;
+      const auto gate = release.get_future().share();
+      const auto blocker = storage.Enqueue("test.scheduler.block", Storage::PRIORITY_HIGH,
+        [&started, gate](const std::shared_ptr<Property>&) { started.set_value(); gate.wait(); }, 1);
+      started.get_future().wait();
+
+      std::mutex mutex;
+      std::vector<std::string> order;
+      const auto record_fn = [&mutex, &order](const std::string& name)
+      {
+        return [&mutex, &order, name](const std::shared_ptr<Property>&) { std::lock_guard<std::mutex> lock(mutex); order.push_back(name); };
+      };
+      const auto a = storage.Enqueue("test.scheduler.a", Storage::PRIORITY_LOW, record_fn("a"), 1);
+      const auto b = storage.Enqueue("test.scheduler.b", Storage::PRIORITY_LOW, record_fn("b"), 1);
+      const auto c = storage.Enqueue("test.scheduler.c", Storage::PRIORITY_NORMAL, record_fn("c"), 1);
+
+      RAYGENE3D_CHECK(test, storage.Reprioritize(b, Storage::PRIORITY_HIGH));
+      RAYGENE3D_CHECK(test, storage.Cancel(a));
+      RAYGENE3D_CHECK(test, !storage.Cancel(a));
+      RAYGENE3D_CHECK(test, !storage.Reprioritize(blocker, Storage::PRIORITY_LOW));
+
+      release.set_value();
+      for (const auto id : { blocker, a, b, c }) storage.Wait(id);
+
+      RAYGENE3D_CHECK(test, order == std::vector<std::string>({ "b", "c" }));
+      RAYGENE3D_CHECK(test, storage.GetMetrics(Storage::PRIORITY_LOW).cancelled == 1);
+      RAYGENE3D_CHECK(test, storage.GetMetrics(Storage::PRIORITY_HIGH).completed == 2);
+      RAYGENE3D_CHECK(test, !storage.Reprioritize(c, Storage::PRIORITY_HIGH));
+    }
+
+    // aliases sharing a blob are loaded with one read, so both see the same bytes
+    {
+      LocalStorage storage;
+      Storage::batch_t batch = { { "test.dedup.a", MakeMesh(7, 4096) }, { "test.dedup.b", MakeMesh(7, 4096) } };
+      const auto results = storage.Save(batch);
+      RAYGENE3D_CHECK(test, results.size() == 2 && results[0] && results[1]);
+
+      // the second copy on disk differs, which only a deduplicated load hides;
+      // the copies may be hard links, so it is replaced rather than rewritten
+      std::map<std::shared_ptr<Property>, std::string> binaries;
+      Property::ToJSON(batch[1].second, binaries);
+      RAYGENE3D_CHECK(test, binaries.size() == 1);
+      const auto suffix = binaries.empty() ? std::string() : binaries.begin()->second;
+      {
+        std::error_code error;
+        RAYGENE3D_CHECK(test, std::filesystem::remove("cache/test.dedup.b" + suffix, error));
+
+        const std::vector<uint8_t> other(4096, 9);
+        std::ofstream file_stream("cache/test.dedup.b" + suffix, std::ios::out | std::ios::binary);
+        file_stream.write(reinterpret_cast<const char*>(other.data()), other.size());
+      }
+
+      Storage::batch_t loads = { { "test.dedup.a", nullptr }, { "test.dedup.b", nullptr } };
+      storage.Load(loads);
+      RAYGENE3D_CHECK(test, IsMesh(loads[0].second, 7, 4096) && IsMesh(loads[1].second, 7, 4096));
+
+      // the copy is backed by the blob it was copied from
+      if (loads[1].second)
+      {
+        const auto raw = loads[1].second->GetObjectItem("raw");
+        RAYGENE3D_CHECK(test, raw->EvictRaw());
+        RAYGENE3D_CHECK(test, IsMesh(loads[1].second, 7, 4096));
+      }
+
+      // a failed read fails its alias, the copies fall back to their own blob
+      std::error_code error;
+      RAYGENE3D_CHECK(test, std::filesystem::remove("cache/test.dedup.a" + suffix, error));
+      loads = { { "test.dedup.a", nullptr }, { "test.dedup.b", nullptr } };
+      storage.Load(loads);
+      RAYGENE3D_CHECK(test, !loads[0].second);
+      RAYGENE3D_CHECK(test, IsMesh(loads[1].second, 9, 4096));
+    }
+
+    // watched aliases pick up what another instance saved, a raw whose sidecar is unchanged is not paged in
+    {
+      const auto make_fn = [](uint8_t value)
+      {
+        const auto scene = std::shared_ptr<Property>(new Property(Property::TYPE_OBJECT));
+        scene->SetObjectItem("kept", MakeMesh(1, 65536));
+        scene->SetObjectItem("changed", MakeMesh(value, 65536));
+        return scene;
+      };
+
+      LocalStorage writer;
+      RAYGENE3D_CHECK(test, writer.Save("test.watch", make_fn(2)));
+
+      LocalStorage storage;
+      std::shared_ptr<Property> scene;
+      storage.Load("test.watch", scene);
+      RAYGENE3D_CHECK(test, scene != nullptr);
+
+      uint32_t notified = 0;
+      storage.Watch("test.watch", scene, [&notified](const std::string&, const std::vector<std::shared_ptr<Property>>& changes) { notified += uint32_t(changes.size()); });
+      storage.StartWatcher();
+      for (uint32_t i = 0; i < 500 && notified == 0; ++i)
+      {
+        if (i % 50 == 0) writer.Save("test.watch", make_fn(3));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        storage.Use();
+      }
+      storage.StopWatcher();
+      RAYGENE3D_CHECK(test, notified != 0);
+      RAYGENE3D_CHECK(test, IsMesh(scene->GetObjectItem("changed"), 3, 65536));
+
+      // saving republishes every sidecar, the watcher would report them all as touched
+      RAYGENE3D_CHECK(test, scene->GetObjectItem("kept")->GetObjectItem("raw")->EvictRaw());
+      RAYGENE3D_CHECK(test, writer.Save("test.watch", make_fn(5)));
+      notified = 0;
+      storage.Refresh("test.watch");
+      RAYGENE3D_CHECK(test, notified == 1);
+      RAYGENE3D_CHECK(test, !scene->GetObjectItem("kept")->GetObjectItem("raw")->IsRawResident());
+      RAYGENE3D_CHECK(test, IsMesh(scene->GetObjectItem("changed"), 5, 65536));
+      RAYGENE3D_CHECK(test, IsMesh(scene->GetObjectItem("kept"), 1, 65536));
+
+      // a sidecar rewritten under its old name is read again when it is reported as touched
+      const auto origin = scene->GetObjectItem("kept")->GetObjectItem("raw")->GetRawOrigin();
+      RAYGENE3D_CHECK(test, origin.length() == std::string("cache/test.watch").length() + 48);
+      const auto suffix = origin.substr(std::min(origin.length(), std::string("cache/test.watch").length()));
+      {
+        std::error_code error;
+        std::filesystem::remove("cache/test.watch" + suffix, error);
+        const std::vector<uint8_t> other(65536, 4);
+        std::ofstream file_stream("cache/test.watch" + suffix, std::ios::out | std::ios::binary);
+        file_stream.write(reinterpret_cast<const char*>(other.data()), other.size());
+      }
+      storage.Refresh("test.watch");
+      RAYGENE3D_CHECK(test, IsMesh(scene->GetObjectItem("kept"), 1, 65536));
+      storage.Refresh("test.watch", { suffix });
+      RAYGENE3D_CHECK(test, notified == 2);
+      RAYGENE3D_CHECK(test, IsMesh(scene->GetObjectItem("kept"), 4, 65536));
+    }
+
+    // saved raws are evicted least recently used first and reload on access
+    {
+      LocalStorage storage;
+      const auto meshes = std::shared_ptr<Property>(new Property(Property::TYPE_ARRAY));
+      meshes->SetArraySize(4);
+      for (uint32_t i = 0; i < 4; ++i) meshes->SetArrayItem(i, MakeMesh(uint8_t(i + 1), 65536));
+      RAYGENE3D_CHECK(test, storage.Save("test.residency", meshes));
+
+      // accesses are ordered by frame, so the touched ones are more recent
+      const auto budget = Raw::GetBudget();
+      Raw::SetBudget(0);
+      Raw::Trim();
+      meshes->GetArrayItem(2)->GetObjectItem("raw")->GetRawBytes(0);
+      meshes->GetArrayItem(3)->GetObjectItem("raw")->GetRawBytes(0);
+
+      const auto before = Raw::GetResidency();
+      Raw::SetBudget(before.resident_bytes - 2 * 65536);
+      Raw::Trim();
+
+      const auto after = Raw::GetResidency();
+      RAYGENE3D_CHECK(test, after.evictions == before.evictions + 2);
+      RAYGENE3D_CHECK(test, !meshes->GetArrayItem(0)->GetObjectItem("raw")->IsRawResident());
+      RAYGENE3D_CHECK(test, !meshes->GetArrayItem(1)->GetObjectItem("raw")->IsRawResident());
+      RAYGENE3D_CHECK(test, meshes->GetArrayItem(3)->GetObjectItem("raw")->IsRawResident());
+      Raw::SetBudget(budget);
+
+      for (uint32_t i = 0; i < 4; ++i) RAYGENE3D_CHECK(test, IsMesh(meshes->GetArrayItem(i), uint8_t(i + 1), 65536));
+      RAYGENE3D_CHECK(test, Raw::GetResidency().reloads >= after.reloads + 2);
+
+      // a backing made from bytes read before a write is refused
+      const auto raw = meshes->GetArrayItem(0)->GetObjectItem("raw");
+      const auto generation = raw->GetRawGeneration();
+      const uint8_t value = 9;
+      raw->SetRawBytes({ &value, 1 }, 0);
+      RAYGENE3D_CHECK(test, !raw->SetRawBacking([]() { return std::shared_ptr<Raw::Source>(); }, generation));
+      RAYGENE3D_CHECK(test, !raw->EvictRaw());
+      RAYGENE3D_CHECK(test, *static_cast<const uint8_t*>(raw->GetRawBytes(0).first) == 9);
+    }
+
+    // checkpoint members are written concurrently, the manifest only when every one of them is in place
+    {
+      Util util(Util::STORAGE_LOCAL);
+      const std::vector<uint8_t> bytes(1024, 3);
+      std::vector<std::shared_ptr<Property>> scenes;
+      for (const auto& name : { "scene", "copy" })
+      {
+        scenes.push_back(std::shared_ptr<Property>(new Property(Property::TYPE_OBJECT)));
+        scenes.back()->SetObjectItem("raw", CreateBufferProperty(bytes.data(), 1, uint32_t(bytes.size())));
+        util.AddProperty(scenes.back(), name);
+      }
+      util.Initialize();
+
+      const auto complete = util.Checkpoint("test.checkpoint").get();
+      RAYGENE3D_CHECK(test, complete.manifest == "test.checkpoint" && complete.failed.empty());
+      RAYGENE3D_CHECK(test, complete.timings.size() == 2);
+
+      std::shared_ptr<Property> copy;
+      util.GetStorage()->Load("test.checkpoint.copy", copy);
+      RAYGENE3D_CHECK(test, copy && copy->GetObjectItem("raw")->GetRawSize() == bytes.size());
+      if (copy) RAYGENE3D_CHECK(test, std::memcmp(copy->GetObjectItem("raw")->GetRawBytes(0).first, bytes.data(), bytes.size()) == 0);
+
+      const auto failed = util.Checkpoint("test.missing/checkpoint").get();
+      RAYGENE3D_CHECK(test, failed.manifest.empty());
+      RAYGENE3D_CHECK(test, failed.failed.size() == 2 && failed.failed[0] == "test.missing/checkpoint.scene");
+
+      std::shared_ptr<Property> manifest;
+      util.GetStorage()->Load("test.missing/checkpoint", manifest);
+      RAYGENE3D_CHECK(test, !manifest);
+
+      util.Discard();
+    }
+  }
+}
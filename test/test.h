@@ -0,0 +1,62 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#pragma once
+#include "../util.h"
+
+namespace RayGene3D
+{
+  // Self-contained test harness. A failed check is reported with its
+  // location and counted, the executable fails when any check failed.
+  class Test
+  {
+  protected:
+    std::string suite;
+    uint32_t checks{ 0 };
+    uint32_t failures{ 0 };
+
+  public:
+    void SetSuite(const std::string& suite) { this->suite = suite; }
+    void Check(bool condition, const char* expression, const char* file, int line);
+
+  public:
+    uint32_t GetChecks() const { return checks; }
+    uint32_t GetFailures() const { return failures; }
+  };
+
+  void RunCodecTest(Test& test);
+  void RunJobTest(Test& test);
+  void RunMemoryTest(Test& test);
+  void RunPropertyTest(Test& test);
+  void RunRawTest(Test& test);
+  void RunSlotMapTest(Test& test);
+  void RunStorageTest(Test& test);
+}
+
+#define RAYGENE3D_CHECK(test, condition) (test).Check(bool(condition), #condition, __FILE__, __LINE__)
@@ -30,23 +30,213 @@ THE SOFTWARE.
 #include "util.h"
 #include "util/storage/local_storage.h"
 
+#include <algorithm>
+#include <cstdio>
+
 namespace RayGene3D
 {
+  namespace
+  {
+    std::atomic<uint64_t> scratch_counter{ 0 };
+  }
+
+  // the arena a thread asked for last, and the utils it holds arenas in, so
+  // that exiting drops them from the utils still alive
+  struct Util::ScratchThread
+  {
+    uint64_t owner{ 0 };
+    uint32_t frame{ 0 };
+    Arena* arena{ nullptr };
+    std::vector<std::weak_ptr<Scratches>> registries;
+
+    ~ScratchThread()
+    {
+      for (const auto& registry : registries)
+      {
+        if (const auto scratches = registry.lock())
+        {
+          std::lock_guard<std::mutex> lock(scratches->mutex);
+          scratches->threads.erase(std::this_thread::get_id());
+        }
+      }
+    }
+  };
+
+  thread_local Util::ScratchThread Util::scratch_thread;
+
   void Util::Initialize()
   {
+    jobs.Start(job_count, job_pinning);
+    JobSystem::SetCurrent(&jobs);
   }
 
   void Util::Use()
   {
+    frames[++frame_index & 1].Reset();
+
+    if (storage)
+    {
+      storage->Use();
+    }
+
+    Raw::Trim();
   }
 
   void Util::Discard()
   {
+    if (JobSystem::GetCurrent() == &jobs)
+    {
+      JobSystem::SetCurrent(nullptr);
+    }
+    jobs.Stop();
+
+#ifdef RAYGENE3D_TRACING
+    std::fprintf(stderr, "%s", Trace::GetSummary().c_str());
+    if (!trace_file.empty()) Trace::WriteChrome(trace_file);
+#endif
+
+#ifndef NDEBUG
+    std::fprintf(stderr, "raygene3d-util: frame arena high water %zu/%zu bytes, %u growths\n",
+      std::max(frames[0].GetHighWater(), frames[1].GetHighWater()), std::max(frames[0].GetCapacity(), frames[1].GetCapacity()),
+      frames[0].GetGrowths() + frames[1].GetGrowths());
+    std::lock_guard<std::mutex> lock(scratches->mutex);
+    for (const auto& [thread, scratch] : scratches->threads)
+    {
+      std::fprintf(stderr, "raygene3d-util: scratch arena high water %zu/%zu bytes, %u growths\n",
+        scratch.arena->GetHighWater(), scratch.arena->GetCapacity(), scratch.arena->GetGrowths());
+    }
+#endif
+  }
+
+  Arena& Util::GetScratch()
+  {
+    // only the owning thread ever resets its arena, so no other thread's allocations are freed
+    const uint32_t frame = frame_index;
+    if (scratch_thread.owner == scratch_owner && scratch_thread.frame == frame)
+    {
+      return *scratch_thread.arena;
+    }
+
+    std::lock_guard<std::mutex> lock(scratches->mutex);
+    auto& scratch = scratches->threads[std::this_thread::get_id()];
+    if (!scratch.arena)
+    {
+      scratch.arena.reset(new Arena(scratch_size));
+
+      auto& registries = scratch_thread.registries;
+      registries.erase(std::remove_if(registries.begin(), registries.end(),
+        [](const auto& registry) { return registry.expired(); }), registries.end());
+      registries.push_back(scratches);
+    }
+    else if (scratch.frame != frame)
+    {
+      scratch.arena->Reset();
+    }
+    scratch.frame = frame;
+
+    scratch_thread.owner = scratch_owner;
+    scratch_thread.frame = frame;
+    scratch_thread.arena = scratch.arena.get();
+    return *scratch.arena;
+  }
+
+  std::future<Util::CheckpointReport> Util::Checkpoint(const std::string& name)
+  {
+    const auto start = std::chrono::steady_clock::now();
+
+    CompactProperties();
+
+    // taking the snapshots is cheap, so the registry is only walked once
+    Storage::batch_t batch;
+    for (uint32_t i = 0; i < properties.GetSize(); ++i)
+    {
+      const auto& entry = properties.GetValues()[i];
+      const auto property = entry.property.lock();
+      if (!property) continue;
+
+      // the handle stays unique and stable however the registry is compacted
+      const auto handle = properties.GetHandle(i);
+      const auto suffix = entry.name.empty() ? std::to_string(handle.index) + '-' + std::to_string(handle.generation) : entry.name;
+      batch.push_back({ name + '.' + suffix, Property::Snapshot(property) });
+    }
+
+    const auto save = [this, name, start, batch = std::move(batch)]()
+    {
+      CheckpointReport checkpoint;
+
+      if (!storage)
+      {
+        for (const auto& [alias, property] : batch) checkpoint.failed.push_back(alias);
+        checkpoint.total = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        return checkpoint;
+      }
+
+      Storage::timings_t timings;
+      const auto results = storage->Save(batch, timings);
+
+      for (size_t i = 0; i < batch.size(); ++i)
+      {
+        checkpoint.timings.push_back({ batch[i].first, timings[i] });
+        if (!results[i]) checkpoint.failed.push_back(batch[i].first);
+      }
+
+      // the manifest goes last, so it never names a member that is not in place
+      if (checkpoint.failed.empty())
+      {
+        const auto manifest = std::shared_ptr<Property>(new Property(Property::TYPE_ARRAY));
+        manifest->SetArraySize(uint32_t(batch.size()));
+        for (uint32_t i = 0; i < uint32_t(batch.size()); ++i)
+        {
+          const auto alias = std::shared_ptr<Property>(new Property(Property::TYPE_STRING));
+          alias->SetString(batch[i].first);
+          manifest->SetArrayItem(i, alias);
+        }
+
+        if (storage->Save(name, manifest))
+        {
+          checkpoint.manifest = name;
+        }
+        else
+        {
+          checkpoint.failed.push_back(name);
+        }
+      }
+
+      checkpoint.total = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+      return checkpoint;
+    };
+
+    const auto promise = std::make_shared<std::promise<CheckpointReport>>();
+    auto result = promise->get_future();
+
+    const auto run = [promise, save]()
+    {
+      try
+      {
+        promise->set_value(save());
+      }
+      catch (...)
+      {
+        promise->set_exception(std::current_exception());
+      }
+    };
+
+    if (jobs.IsRunning())
+    {
+      jobs.Submit(run);
+    }
+    else
+    {
+      run();
+    }
+
+    return result;
   }
 
   Util::Util(StorageType type)
     : Usable("raygene3d-util")
     , type(type)
+    , scratch_owner(++scratch_counter)
   {
     switch (type)
     {
@@ -58,5 +248,11 @@ namespace RayGene3D
 
   Util::~Util()
   {
+    // pending checkpoints still write to the storage, which goes first
+    if (JobSystem::GetCurrent() == &jobs)
+    {
+      JobSystem::SetCurrent(nullptr);
+    }
+    jobs.Stop();
   };
 }
\ No newline at end of file
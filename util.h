@@ -28,6 +28,11 @@ THE SOFTWARE.
 
 #pragma once
 #include "util/storage.h"
+#include "util/slot_map.h"
+#include "util/job_system.h"
+#include "util/arena.h"
+
+#include <future>
 
 namespace RayGene3D
 {
@@ -44,11 +49,69 @@ namespace RayGene3D
   protected:
     StorageType type;
 
+  protected:
+    JobSystem jobs;
+    uint32_t job_count{ 0 };
+    bool job_pinning{ false };
+
   protected:
     std::unique_ptr<Storage> storage;
 
   protected:
-    std::list<std::weak_ptr<Property>> properties;
+    Arena frames[2]{ Arena(size_t(1) << 20), Arena(size_t(1) << 20) };
+    std::atomic<uint32_t> frame_index{ 0 };
+
+  protected:
+    struct Scratch
+    {
+      std::unique_ptr<Arena> arena;
+      uint32_t frame{ 0 };
+    };
+    struct Scratches
+    {
+      std::mutex mutex;
+      std::unordered_map<std::thread::id, Scratch> threads;
+    };
+    struct ScratchThread;
+    static thread_local ScratchThread scratch_thread;
+
+  protected:
+    uint64_t scratch_owner{ 0 };
+    size_t scratch_size{ size_t(256) << 10 };
+    std::shared_ptr<Scratches> scratches{ std::make_shared<Scratches>() };
+
+  protected:
+    std::string trace_file;
+
+  protected:
+    struct Entry
+    {
+      std::weak_ptr<Property> property;
+      std::string name;
+    };
+
+  public:
+    typedef SlotMap<Entry>::Handle handle_t;
+
+  public:
+    struct CheckpointReport
+    {
+      std::string manifest;  // empty unless every member and the manifest were written
+      std::vector<std::string> failed;
+      std::vector<std::pair<std::string, std::chrono::microseconds>> timings;
+      std::chrono::microseconds total{ 0 };
+    };
+
+  protected:
+    SlotMap<Entry> properties;
+    uint32_t compact_threshold{ 64 };
+
+  protected:
+    void CompactProperties()
+    {
+      properties.EraseIf([](const Entry& entry) { return entry.property.expired(); });
+      compact_threshold = std::max(64u, 2 * properties.GetSize());
+    }
 
   public:
     void Initialize() override;
@@ -59,9 +122,55 @@ namespace RayGene3D
     const std::unique_ptr<Storage>& GetStorage() { return storage; }
 
   public:
-    void AddProperty(const std::shared_ptr<Property>& property) { return properties.push_back(property); }
-    void VisitProperty(std::function<void(const std::shared_ptr<Property>&)> visitor) { for (const auto& property : properties) visitor(property.lock()); }
-    //void RemoveProperty(const std::shared_ptr<Property>& property) { return properties.remove(property); }
+    // takes effect on the next Initialize, count of 0 picks one from the hardware
+    void SetJobs(uint32_t count, bool pinning = false) { job_count = count; job_pinning = pinning; }
+    JobSystem& GetJobs() { return jobs; }
+
+  public:
+    // Memory from the frame arena lives until the Use after next, so a frame
+    // may still read what the previous one built. Meant for the thread
+    // calling Use. Both arenas are reset by Use at the frame boundary.
+    Arena& GetFrameArena() { return frames[frame_index & 1]; }
+    const Arena& GetFrameArena(uint32_t parity) const { return frames[parity & 1]; }
+    // the calling thread's scratch arena, nothing in it may be held across Use,
+    // as the thread resets it the first time it asks for it after a Use
+    Arena& GetScratch();
+    void SetScratchSize(size_t size) { scratch_size = size; }
+
+  public:
+    // with RAYGENE3D_TRACING, Discard prints the trace summary and writes the
+    // captured events to this file as a Chrome trace
+    void SetTraceFile(const std::string& file_name) { trace_file = file_name; Trace::SetCapture(!file_name.empty()); }
+
+  public:
+    // expired entries are dropped whenever the registry doubles and on every visit
+    handle_t AddProperty(const std::shared_ptr<Property>& property, const std::string& name = std::string())
+    {
+      if (properties.GetSize() >= compact_threshold) CompactProperties();
+      return properties.Insert({ property, name });
+    }
+    bool RemoveProperty(handle_t handle) { return properties.Erase(handle); }
+    std::shared_ptr<Property> GetProperty(handle_t handle) const
+    {
+      const auto entry = properties.Find(handle);
+      return entry ? entry->property.lock() : nullptr;
+    }
+    uint32_t CountProperty() const { return properties.GetSize(); }
+    // the visitor must not add or remove properties
+    template<typename F>
+    void VisitProperty(F&& visitor)
+    {
+      CompactProperties();
+      properties.Visit([&visitor](const Entry& entry) { if (const auto locked = entry.property.lock()) visitor(locked); });
+    }
+
+  public:
+    // Saves a snapshot of every registered property as "<name>.<property name>"
+    // in one storage batch, then the manifest "<name>" listing them. Only a
+    // checkpoint with a manifest is complete, so the manifest is skipped when
+    // any member failed. The snapshots are taken before returning and written
+    // on the job system; wait on the result from outside the pool before Discard.
+    std::future<CheckpointReport> Checkpoint(const std::string& name);
 
   public:
     Util(StorageType type);
@@ -0,0 +1,85 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "arena.h"
+
+namespace RayGene3D
+{
+  void* Arena::Overflow(size_t size, size_t alignment)
+  {
+    const auto align_fn = [alignment](const uint8_t* data, size_t offset)
+    {
+      const auto base = reinterpret_cast<uintptr_t>(data);
+      return size_t(((base + offset + alignment - 1) & ~uintptr_t(alignment - 1)) - base);
+    };
+
+    auto aligned = overflow.empty() ? 0 : align_fn(overflow.back().get(), overflow_offset);
+    if (overflow.empty() || aligned + size > overflow_capacity)
+    {
+      // the rest of the main block is abandoned until Reset
+      overflow_used += overflow_offset;
+
+      overflow_capacity = std::max(std::max(capacity, size_t(4096)), size + alignment);
+      overflow.emplace_back(new uint8_t[overflow_capacity]);
+      overflow_offset = 0;
+      growths += 1;
+
+      aligned = align_fn(overflow.back().get(), 0);
+    }
+
+    overflow_offset = aligned + size;
+    return overflow.back().get() + aligned;
+  }
+
+  void Arena::Reset()
+  {
+    const auto used = GetUsed();
+    high_water = std::max(high_water, used);
+
+    if (!overflow.empty())
+    {
+      overflow.clear();
+      overflow_used = 0;
+      overflow_offset = 0;
+      overflow_capacity = 0;
+
+      // one block large enough for the whole frame next time
+      capacity = std::max(2 * capacity, used + used / 2);
+      block.reset(new uint8_t[capacity]);
+    }
+
+    offset = 0;
+  }
+
+  Arena::Arena(size_t capacity)
+    : block(capacity ? new uint8_t[capacity] : nullptr)
+    , capacity(capacity)
+  {
+  }
+}
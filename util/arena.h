@@ -0,0 +1,133 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+#pragma once
+#include "types.h"
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+
+namespace RayGene3D
+{
+  // Bump allocator: allocating is a pointer increment and memory is handed
+  // back all at once by Reset or by rewinding to a mark. A frame outgrowing
+  // the block chains extra blocks, which the next Reset folds into a single
+  // larger one, so a steady frame never reaches the heap. Not thread-safe.
+  class Arena
+  {
+  public:
+    typedef size_t mark_t;
+
+  protected:
+    std::unique_ptr<uint8_t[]> block;
+    size_t capacity{ 0 };
+    size_t offset{ 0 };
+
+  protected:
+    std::vector<std::unique_ptr<uint8_t[]>> overflow;
+    size_t overflow_used{ 0 };
+    size_t overflow_offset{ 0 };
+    size_t overflow_capacity{ 0 };
+
+  protected:
+    size_t high_water{ 0 };
+    uint32_t growths{ 0 };
+
+  protected:
+    void* Overflow(size_t size, size_t alignment);
+
+  public:
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+      const auto base = reinterpret_cast<uintptr_t>(block.get());
+      const auto aligned = size_t(((base + offset + alignment - 1) & ~uintptr_t(alignment - 1)) - base);
+      if (overflow.empty() && aligned + size <= capacity)
+      {
+        offset = aligned + size;
+        return block.get() + aligned;
+      }
+      return Overflow(size, alignment);
+    }
+
+    // uninitialised storage for count items, only for types needing no destructor
+    template<typename T>
+    T* Allocate(size_t count)
+    {
+      static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+      return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+  public:
+    // rewinding does nothing once the frame overflowed, the memory returns on Reset
+    mark_t Mark() const { return offset; }
+    void Rewind(mark_t mark) { if (overflow.empty() && mark <= offset) offset = mark; }
+    void Reset();
+
+  public:
+    size_t GetUsed() const { return offset + overflow_used + overflow_offset; }
+    size_t GetCapacity() const { return capacity; }
+    size_t GetHighWater() const { return std::max(high_water, GetUsed()); }
+    uint32_t GetGrowths() const { return growths; }
+
+  public:
+    Arena(size_t capacity = 0);
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+  };
+
+  // Standard allocator over an arena, e.g. for per-frame std::vector lists.
+  // Deallocation is a no-op, the memory returns with the arena reset.
+  template<typename T>
+  class ArenaAllocator
+  {
+    template<typename U>
+    friend class ArenaAllocator;
+
+  public:
+    typedef T value_type;
+
+  protected:
+    Arena* arena{ nullptr };
+
+  public:
+    T* allocate(size_t count) { return static_cast<T*>(arena->Allocate(count * sizeof(T), alignof(T))); }
+    void deallocate(T*, size_t) {}
+
+  public:
+    template<typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+  public:
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+    ArenaAllocator(Arena& arena) : arena(&arena) {}
+  };
+}
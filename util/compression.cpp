@@ -0,0 +1,855 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "compression.h"
+#include "job_system.h"
+
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace RayGene3D
+{
+  namespace
+  {
+    const uint32_t chunk_magic = 0x5a334752; // "RG3Z"
+    const uint32_t chunk_header = 4 * sizeof(uint32_t);
+
+    const uint32_t geometry_magic = 0x47334752; // "RG3G"
+    const uint32_t geometry_header = 3 * sizeof(uint32_t);
+
+    const uint32_t vertex_lanes = sizeof(Vertex) / sizeof(uint32_t);
+    const uint32_t vertex_header = (3 + 2 * vertex_lanes) * sizeof(uint32_t);
+    const uint32_t triangle_cache = 16;
+
+    static_assert(sizeof(Vertex) == 64 && sizeof(Triangle) == 12, "unexpected geometry layout");
+
+    uint32_t LaneBits(uint32_t lane, uint32_t position_bits, uint32_t texcoord_bits)
+    {
+      return lane < 3 ? position_bits : lane >= 12 ? texcoord_bits : 0;
+    }
+
+    const uint32_t min_match = 4;
+    const uint32_t last_literals = 5;
+    const uint32_t match_limit = 12;
+    const uint32_t hash_log = 12;
+
+    uint32_t Read32(const uint8_t* ptr)
+    {
+      uint32_t value;
+      std::memcpy(&value, ptr, sizeof(value));
+      return value;
+    }
+
+#if defined(__SSE2__)
+    // Decodes whole groups of 16 vertices, four lanes at a time: the four byte
+    // planes of a lane are merged by unpacking, unzigzagged and prefix-summed
+    // in registers, then four lanes of four vertices are transposed so every
+    // store writes 16 contiguous bytes. Returns the number of vertices done.
+    uint32_t DecodeVertexGroups(const uint8_t* planes, uint32_t count, const uint32_t* bits, const float* minimum, const float* scale,
+      uint8_t* dst, uint32_t* previous)
+    {
+      const auto one = _mm_set1_epi32(1);
+      const auto zero = _mm_setzero_si128();
+
+      __m128i carry[vertex_lanes];
+      for (uint32_t lane = 0; lane < vertex_lanes; ++lane) carry[lane] = _mm_set1_epi32(int(previous[lane]));
+
+      const auto groups = count / 16;
+      for (uint32_t group = 0; group < groups; ++group)
+      {
+        const auto base = group * 16;
+        for (uint32_t quad = 0; quad < vertex_lanes; quad += 4)
+        {
+          __m128i values[4][4];
+          for (uint32_t j = 0; j < 4; ++j)
+          {
+            const auto lane = quad + j;
+            const auto plane = planes + size_t(lane) * 4 * count + base;
+            const auto b0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(plane));
+            const auto b1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(plane + count));
+            const auto b2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(plane + 2 * size_t(count)));
+            const auto b3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(plane + 3 * size_t(count)));
+
+            const auto low0 = _mm_unpacklo_epi8(b0, b1);
+            const auto low1 = _mm_unpackhi_epi8(b0, b1);
+            const auto high0 = _mm_unpacklo_epi8(b2, b3);
+            const auto high1 = _mm_unpackhi_epi8(b2, b3);
+            const __m128i zigzag[4] = { _mm_unpacklo_epi16(low0, high0), _mm_unpackhi_epi16(low0, high0), _mm_unpacklo_epi16(low1, high1), _mm_unpackhi_epi16(low1, high1) };
+
+            auto sum = carry[lane];
+            for (uint32_t k = 0; k < 4; ++k)
+            {
+              auto value = _mm_xor_si128(_mm_srli_epi32(zigzag[k], 1), _mm_sub_epi32(zero, _mm_and_si128(zigzag[k], one)));
+              value = _mm_add_epi32(value, _mm_slli_si128(value, 4));
+              value = _mm_add_epi32(value, _mm_slli_si128(value, 8));
+              sum = _mm_add_epi32(value, sum);
+              values[j][k] = sum;
+              sum = _mm_shuffle_epi32(sum, _MM_SHUFFLE(3, 3, 3, 3));
+            }
+            carry[lane] = sum;
+
+            // quantised values stay below 2^24, so the signed conversion is exact
+            if (bits[lane] > 0)
+            {
+              const auto lo = _mm_set1_ps(minimum[lane]);
+              const auto step = _mm_set1_ps(scale[lane]);
+              for (uint32_t k = 0; k < 4; ++k)
+              {
+                values[j][k] = _mm_castps_si128(_mm_add_ps(lo, _mm_mul_ps(_mm_cvtepi32_ps(values[j][k]), step)));
+              }
+            }
+          }
+
+          for (uint32_t k = 0; k < 4; ++k)
+          {
+            const auto t0 = _mm_unpacklo_epi32(values[0][k], values[1][k]);
+            const auto t1 = _mm_unpacklo_epi32(values[2][k], values[3][k]);
+            const auto t2 = _mm_unpackhi_epi32(values[0][k], values[1][k]);
+            const auto t3 = _mm_unpackhi_epi32(values[2][k], values[3][k]);
+
+            const auto out = dst + (size_t(base + 4 * k) * vertex_lanes + quad) * sizeof(uint32_t);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 0 * sizeof(Vertex)), _mm_unpacklo_epi64(t0, t1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 1 * sizeof(Vertex)), _mm_unpackhi_epi64(t0, t1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * sizeof(Vertex)), _mm_unpacklo_epi64(t2, t3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 3 * sizeof(Vertex)), _mm_unpackhi_epi64(t2, t3));
+          }
+        }
+      }
+
+      for (uint32_t lane = 0; lane < vertex_lanes; ++lane) previous[lane] = uint32_t(_mm_cvtsi128_si32(carry[lane]));
+      return groups * 16;
+    }
+#endif
+  }
+
+  uint32_t CompressBound(uint32_t size)
+  {
+    return size + size / 255 + 16;
+  }
+
+  uint32_t CompressBlock(const uint8_t* src, uint32_t src_size, uint8_t* dst, uint32_t dst_capacity)
+  {
+    uint32_t table[1 << hash_log] = {};
+    const auto hash_fn = [](uint32_t sequence) { return (sequence * 2654435761u) >> (32 - hash_log); };
+
+    auto op = dst;
+    const auto oend = dst + dst_capacity;
+
+    const auto length_fn = [&op](uint32_t length)
+    {
+      for (; length >= 255; length -= 255) *op++ = 255;
+      *op++ = uint8_t(length);
+    };
+
+    const auto sequence_fn = [&op, &oend, &length_fn](const uint8_t* literals, uint32_t literal_length, uint32_t offset, uint32_t match_length)
+    {
+      const auto required = 1 + literal_length / 255 + 1 + literal_length + (match_length > 0 ? 2 + match_length / 255 + 1 : 0);
+      if (uint32_t(oend - op) < required)
+      {
+        return false;
+      }
+
+      const auto match_code = match_length > 0 ? match_length - min_match : 0;
+      *op++ = uint8_t((std::min(literal_length, 15u) << 4) | std::min(match_code, 15u));
+      if (literal_length >= 15) length_fn(literal_length - 15);
+
+      if (literal_length > 0) std::memcpy(op, literals, literal_length);
+      op += literal_length;
+
+      if (match_length > 0)
+      {
+        *op++ = uint8_t(offset);
+        *op++ = uint8_t(offset >> 8);
+        if (match_code >= 15) length_fn(match_code - 15);
+      }
+      return true;
+    };
+
+    uint32_t anchor = 0;
+    if (src_size > match_limit)
+    {
+      const auto input_limit = src_size - match_limit;
+      const auto match_end_limit = src_size - last_literals;
+
+      for (uint32_t ip = 0; ip < input_limit;)
+      {
+        const auto sequence = Read32(src + ip);
+        const auto hash = hash_fn(sequence);
+        const auto ref = table[hash];
+        table[hash] = ip;
+
+        if (ref >= ip || ip - ref > 65535 || Read32(src + ref) != sequence)
+        {
+          ++ip;
+          continue;
+        }
+
+        auto start = ip;
+        auto start_ref = ref;
+        while (start > anchor && start_ref > 0 && src[start - 1] == src[start_ref - 1])
+        {
+          --start;
+          --start_ref;
+        }
+
+        auto length = min_match;
+        while (ip + length < match_end_limit && src[ip + length] == src[ref + length])
+        {
+          ++length;
+        }
+
+        const auto match_length = length + (ip - start);
+        if (!sequence_fn(src + anchor, start - anchor, ip - ref, match_length))
+        {
+          return 0;
+        }
+
+        ip = start + match_length;
+        anchor = ip;
+        if (ip >= 2 && ip - 2 < input_limit) table[hash_fn(Read32(src + ip - 2))] = ip - 2;
+      }
+    }
+
+    if (!sequence_fn(src + anchor, src_size - anchor, 0, 0))
+    {
+      return 0;
+    }
+
+    return uint32_t(op - dst);
+  }
+
+  bool DecompressBlock(const uint8_t* src, uint32_t src_size, uint8_t* dst, uint32_t dst_size)
+  {
+    auto ip = src;
+    const auto iend = src + src_size;
+    auto op = dst;
+    const auto oend = dst + dst_size;
+
+    const auto length_fn = [&ip, &iend](uint32_t& length)
+    {
+      for (uint8_t byte = 255; byte == 255;)
+      {
+        if (ip >= iend) return false;
+        byte = *ip++;
+        length += byte;
+      }
+      return true;
+    };
+
+    while (ip < iend)
+    {
+      const auto token = *ip++;
+
+      uint32_t literal_length = token >> 4;
+      if (literal_length == 15 && !length_fn(literal_length)) return false;
+      if (literal_length > uint32_t(iend - ip) || literal_length > uint32_t(oend - op)) return false;
+
+      if (literal_length > 0) std::memcpy(op, ip, literal_length);
+      ip += literal_length;
+      op += literal_length;
+
+      if (ip == iend)
+      {
+        break;
+      }
+
+      if (iend - ip < 2) return false;
+      const auto offset = uint32_t(ip[0]) | (uint32_t(ip[1]) << 8);
+      ip += 2;
+      if (offset == 0 || offset > uint32_t(op - dst)) return false;
+
+      uint32_t match_length = token & 15;
+      if (match_length == 15 && !length_fn(match_length)) return false;
+      match_length += min_match;
+      if (match_length > uint32_t(oend - op)) return false;
+
+      // an overlapping match repeats its first offset bytes, the repeated part doubles with every copy
+      const auto match = op - offset;
+      for (uint32_t copied = 0; copied < match_length;)
+      {
+        const auto step = std::min(match_length - copied, offset + copied);
+        std::memcpy(op + copied, match, step);
+        copied += step;
+      }
+      op += match_length;
+    }
+
+    return op == oend;
+  }
+
+  std::vector<uint8_t> CompressChunks(std::pair<const void*, uint32_t> bytes, uint32_t chunk_size)
+  {
+    const auto [data, size] = bytes;
+    const auto src = reinterpret_cast<const uint8_t*>(data);
+    const auto chunk_count = (size + chunk_size - 1) / chunk_size;
+
+    std::vector<std::vector<uint8_t>> packed(chunk_count);
+    JobSystem::For(chunk_count, [src, size, chunk_size, &packed](uint32_t i)
+      {
+        const auto chunk_offset = i * chunk_size;
+        const auto chunk_length = std::min(chunk_size, size - chunk_offset);
+
+        auto& chunk = packed[i];
+        chunk.resize(CompressBound(chunk_length));
+        const auto length = CompressBlock(src + chunk_offset, chunk_length, chunk.data(), uint32_t(chunk.size()));
+
+        // incompressible chunks are stored as is and recognised by their length
+        if (length == 0 || length >= chunk_length)
+        {
+          chunk.assign(src + chunk_offset, src + chunk_offset + chunk_length);
+        }
+        else
+        {
+          chunk.resize(length);
+        }
+      });
+
+    std::vector<uint32_t> header = { chunk_magic, size, chunk_size, chunk_count };
+    header.push_back(0);
+    for (const auto& chunk : packed)
+    {
+      header.push_back(header.back() + uint32_t(chunk.size()));
+    }
+
+    std::vector<uint8_t> result(header.size() * sizeof(uint32_t) + header.back());
+    std::memcpy(result.data(), header.data(), header.size() * sizeof(uint32_t));
+
+    auto dst = result.data() + header.size() * sizeof(uint32_t);
+    for (const auto& chunk : packed)
+    {
+      std::memcpy(dst, chunk.data(), chunk.size());
+      dst += chunk.size();
+    }
+
+    return result;
+  }
+
+  bool IsCompressedChunks(std::pair<const void*, uint32_t> bytes)
+  {
+    const auto [data, size] = bytes;
+    const auto src = reinterpret_cast<const uint8_t*>(data);
+
+    if (size < chunk_header + sizeof(uint32_t) || Read32(src) != chunk_magic)
+    {
+      return false;
+    }
+
+    const auto raw_size = Read32(src + 4);
+    const auto chunk_size = Read32(src + 8);
+    const auto chunk_count = Read32(src + 12);
+    if (chunk_size == 0 || uint64_t(chunk_count) != (uint64_t(raw_size) + chunk_size - 1) / chunk_size)
+    {
+      return false;
+    }
+
+    const auto table_end = uint64_t(chunk_header) + (uint64_t(chunk_count) + 1) * sizeof(uint32_t);
+    if (table_end > size)
+    {
+      return false;
+    }
+
+    // every entry has to be in order and in bounds, and no chunk larger than its worst case
+    const auto payload = uint32_t(size - table_end);
+    const auto table = src + chunk_header;
+    if (Read32(table) != 0)
+    {
+      return false;
+    }
+    for (uint32_t i = 0; i < chunk_count; ++i)
+    {
+      const auto begin = Read32(table + i * sizeof(uint32_t));
+      const auto end = Read32(table + (i + 1) * sizeof(uint32_t));
+      const auto chunk_length = std::min(chunk_size, raw_size - i * chunk_size);
+      if (end < begin || end > payload || end - begin == 0 || end - begin > CompressBound(chunk_length))
+      {
+        return false;
+      }
+    }
+    return Read32(table + chunk_count * sizeof(uint32_t)) == payload;
+  }
+
+  void ChunkSource::Fetch(uint8_t* bytes, uint32_t offset, uint32_t size)
+  {
+    if (remaining == 0 || size == 0)
+    {
+      return;
+    }
+
+    // chunks are claimed under the lock and decoded outside it, chunks
+    // another thread is decoding are waited for
+    std::vector<uint32_t> missing;
+    std::vector<uint32_t> pending;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for (auto i = offset / chunk_size; i <= (offset + size - 1) / chunk_size; ++i)
+      {
+        if (decoded[i] == CHUNK_MISSING) { decoded[i] = CHUNK_DECODING; missing.push_back(i); }
+        else if (decoded[i] == CHUNK_DECODING) pending.push_back(i);
+      }
+    }
+
+    std::atomic<bool> failed{ false };
+    JobSystem::For(uint32_t(missing.size()), [this, bytes, &missing, &failed](uint32_t i)
+      {
+        const auto chunk = missing[i];
+        const auto chunk_offset = chunk * chunk_size;
+        const auto chunk_length = std::min(chunk_size, raw_size - chunk_offset);
+        const auto begin = Read32(table + chunk * sizeof(uint32_t));
+        const auto packed_length = Read32(table + (chunk + 1) * sizeof(uint32_t)) - begin;
+
+        if (packed_length == chunk_length)
+        {
+          std::memcpy(bytes + chunk_offset, chunks + begin, chunk_length);
+        }
+        else if (!DecompressBlock(chunks + begin, packed_length, bytes + chunk_offset, chunk_length))
+        {
+          failed = true;
+        }
+      });
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (const auto chunk : missing)
+    {
+      decoded[chunk] = failed ? CHUNK_MISSING : CHUNK_DECODED;
+    }
+    if (!missing.empty())
+    {
+      condition.notify_all();
+    }
+
+    if (failed)
+    {
+      throw std::runtime_error("decompression failed");
+    }
+
+    remaining -= uint32_t(missing.size());
+    if (remaining == 0)
+    {
+      data.clear();
+      data.shrink_to_fit();
+    }
+
+    condition.wait(lock, [this, &pending]()
+      {
+        for (const auto chunk : pending) if (decoded[chunk] == CHUNK_DECODING) return false;
+        return true;
+      });
+    for (const auto chunk : pending)
+    {
+      if (decoded[chunk] != CHUNK_DECODED) throw std::runtime_error("decompression failed");
+    }
+  }
+
+  ChunkSource::ChunkSource(std::vector<uint8_t>&& data)
+    : data(std::move(data))
+  {
+    if (!IsCompressedChunks({ this->data.data(), uint32_t(this->data.size()) }))
+    {
+      throw std::runtime_error("invalid compressed chunks");
+    }
+
+    raw_size = Read32(this->data.data() + 4);
+    chunk_size = Read32(this->data.data() + 8);
+    chunk_count = Read32(this->data.data() + 12);
+    table = this->data.data() + chunk_header;
+    chunks = this->data.data() + chunk_header + (chunk_count + 1) * sizeof(uint32_t);
+
+    decoded.assign(chunk_count, CHUNK_MISSING);
+    remaining = chunk_count;
+  }
+
+  std::vector<uint8_t> EncodeVertices(const Vertex* vertices, uint32_t count, uint32_t position_bits, uint32_t texcoord_bits)
+  {
+    position_bits = std::min(position_bits, 24u);
+    texcoord_bits = std::min(texcoord_bits, 24u);
+
+    // lanes are copied out as bits, the vertex is never read through another type
+    const auto src = reinterpret_cast<const uint8_t*>(vertices);
+    const auto lane_fn = [src](uint32_t i, uint32_t lane)
+    {
+      uint32_t value;
+      std::memcpy(&value, src + (size_t(i) * vertex_lanes + lane) * sizeof(uint32_t), sizeof(value));
+      return value;
+    };
+
+    std::vector<uint8_t> result(vertex_header + size_t(count) * sizeof(Vertex));
+    const uint32_t header[] = { count, position_bits, texcoord_bits };
+    float minimum[vertex_lanes], scale[vertex_lanes];
+
+    auto planes = result.data() + vertex_header;
+    for (uint32_t lane = 0; lane < vertex_lanes; ++lane)
+    {
+      const auto bits = LaneBits(lane, position_bits, texcoord_bits);
+
+      minimum[lane] = 0.0f;
+      scale[lane] = 0.0f;
+      if (bits > 0 && count > 0)
+      {
+        float lo = FLT_MAX, hi = -FLT_MAX;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          float value;
+          const auto word = lane_fn(i, lane);
+          std::memcpy(&value, &word, sizeof(value));
+          lo = std::min(lo, value);
+          hi = std::max(hi, value);
+        }
+        minimum[lane] = lo;
+        scale[lane] = (hi - lo) / float((1u << bits) - 1);
+      }
+      const auto inverse = scale[lane] > 0.0f ? 1.0f / scale[lane] : 0.0f;
+
+      auto plane = planes + size_t(lane) * 4 * count;
+      uint32_t previous = 0;
+      for (uint32_t i = 0; i < count; ++i)
+      {
+        auto value = lane_fn(i, lane);
+        if (bits > 0)
+        {
+          float real;
+          std::memcpy(&real, &value, sizeof(real));
+          value = uint32_t(std::lround((real - minimum[lane]) * inverse));
+        }
+
+        const auto delta = value - previous;
+        previous = value;
+        const auto zigzag = (delta << 1) ^ uint32_t(int32_t(delta) >> 31);
+
+        plane[i + 0 * count] = uint8_t(zigzag);
+        plane[i + 1 * count] = uint8_t(zigzag >> 8);
+        plane[i + 2 * count] = uint8_t(zigzag >> 16);
+        plane[i + 3 * count] = uint8_t(zigzag >> 24);
+      }
+    }
+
+    std::memcpy(result.data(), header, sizeof(header));
+    std::memcpy(result.data() + sizeof(header), minimum, sizeof(minimum));
+    std::memcpy(result.data() + sizeof(header) + sizeof(minimum), scale, sizeof(scale));
+
+    return result;
+  }
+
+  bool DecodeVertices(std::pair<const void*, uint32_t> bytes, Vertex* vertices, uint32_t count)
+  {
+    const auto [data, size] = bytes;
+    if (size < vertex_header || size != vertex_header + uint64_t(count) * sizeof(Vertex))
+    {
+      return false;
+    }
+
+    const auto header = reinterpret_cast<const uint8_t*>(data);
+    if (Read32(header) != count)
+    {
+      return false;
+    }
+    const auto position_bits = Read32(header + 4);
+    const auto texcoord_bits = Read32(header + 8);
+
+    float minimum[vertex_lanes], scale[vertex_lanes];
+    std::memcpy(minimum, header + 12, sizeof(minimum));
+    std::memcpy(scale, header + 12 + sizeof(minimum), sizeof(scale));
+
+    const auto dst = reinterpret_cast<uint8_t*>(vertices);
+    const auto planes = header + vertex_header;
+
+    uint32_t bits[vertex_lanes];
+    for (uint32_t lane = 0; lane < vertex_lanes; ++lane) bits[lane] = LaneBits(lane, position_bits, texcoord_bits);
+
+    uint32_t previous[vertex_lanes] = {};
+    uint32_t first = 0;
+#if defined(__SSE2__)
+    first = DecodeVertexGroups(planes, count, bits, minimum, scale, dst, previous);
+#endif
+
+    // the remainder, or everything without SSE2, is decoded in blocks so the
+    // interleaved output stays in cache while all lanes are scattered into it
+    const uint32_t block = 256;
+    uint32_t values[block];
+
+    for (uint32_t base = first; base < count; base += block)
+    {
+      const auto length = std::min(block, count - base);
+
+      for (uint32_t lane = 0; lane < vertex_lanes; ++lane)
+      {
+        const auto plane = planes + size_t(lane) * 4 * count + base;
+
+        // byte planes are merged, unzigzagged and prefix-summed in separate simple loops so they vectorise
+        for (uint32_t i = 0; i < length; ++i)
+        {
+          const auto zigzag = uint32_t(plane[i]) | (uint32_t(plane[i + count]) << 8) | (uint32_t(plane[i + 2 * count]) << 16) | (uint32_t(plane[i + 3 * count]) << 24);
+          values[i] = (zigzag >> 1) ^ (0u - (zigzag & 1u));
+        }
+
+        auto sum = previous[lane];
+        for (uint32_t i = 0; i < length; ++i)
+        {
+          sum += values[i];
+          values[i] = sum;
+        }
+        previous[lane] = sum;
+
+        if (bits[lane] > 0)
+        {
+          for (uint32_t i = 0; i < length; ++i)
+          {
+            const auto real = minimum[lane] + float(values[i]) * scale[lane];
+            std::memcpy(&values[i], &real, sizeof(real));
+          }
+        }
+
+        for (uint32_t i = 0; i < length; ++i)
+        {
+          std::memcpy(dst + (size_t(base + i) * vertex_lanes + lane) * sizeof(uint32_t), &values[i], sizeof(uint32_t));
+        }
+      }
+    }
+
+    return true;
+  }
+
+  std::vector<uint8_t> EncodeTriangles(const Triangle* triangles, uint32_t count)
+  {
+    std::vector<uint8_t> result(sizeof(uint32_t));
+    std::memcpy(result.data(), &count, sizeof(count));
+    result.reserve(sizeof(uint32_t) + size_t(count) * 3);
+
+    // code 0 is the next unreferenced vertex, 1..16 a hit in the FIFO cache,
+    // anything above a zigzag delta to the previous index
+    uint32_t cache[triangle_cache] = {};
+    uint32_t cache_head = 0;
+    uint32_t next = 0;
+    uint32_t previous = 0;
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+      for (uint32_t j = 0; j < 3; ++j)
+      {
+        const auto index = triangles[i].idx[j];
+
+        uint32_t code = 0;
+        if (index != next)
+        {
+          uint32_t k = 0;
+          while (k < triangle_cache && cache[(cache_head + triangle_cache - 1 - k) % triangle_cache] != index) ++k;
+          if (k < triangle_cache)
+          {
+            code = 1 + k;
+          }
+          else
+          {
+            const auto delta = index - previous;
+            code = 1 + triangle_cache + ((delta << 1) ^ uint32_t(int32_t(delta) >> 31));
+          }
+        }
+        else
+        {
+          next += 1;
+        }
+
+        if (code == 0 || code > triangle_cache)
+        {
+          cache[cache_head] = index;
+          cache_head = (cache_head + 1) % triangle_cache;
+        }
+        next = std::max(next, index + 1);
+        previous = index;
+
+        for (; code >= 0x80; code >>= 7) result.push_back(uint8_t(code | 0x80));
+        result.push_back(uint8_t(code));
+      }
+    }
+
+    return result;
+  }
+
+  bool DecodeTriangles(std::pair<const void*, uint32_t> bytes, Triangle* triangles, uint32_t count)
+  {
+    const auto [data, size] = bytes;
+    auto ip = reinterpret_cast<const uint8_t*>(data);
+    const auto iend = ip + size;
+
+    if (size < sizeof(uint32_t) || Read32(ip) != count)
+    {
+      return false;
+    }
+    ip += sizeof(uint32_t);
+
+    // hits only read the FIFO, and its newest entry is also kept in a register
+    // so the most common hit does not wait for the store it reads
+    uint32_t cache[triangle_cache] = {};
+    uint32_t cache_head = 0;
+    uint32_t newest = 0;
+    uint32_t next = 0;
+    uint32_t previous = 0;
+
+    const auto index_fn = [&cache, &cache_head, &newest, &next, &previous](uint32_t code)
+    {
+      if (code - 1 < triangle_cache)
+      {
+        previous = code == 1 ? newest : cache[(cache_head + triangle_cache - code) % triangle_cache];
+        return previous;
+      }
+
+      const auto zigzag = code - 1 - triangle_cache;
+      const auto index = code == 0 ? next : previous + ((zigzag >> 1) ^ (0u - (zigzag & 1u)));
+      cache[cache_head] = index;
+      cache_head = (cache_head + 1) % triangle_cache;
+      newest = index;
+      next = std::max(next, index + 1);
+      previous = index;
+      return index;
+    };
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+      // most triangles are three single-byte codes, read with one load
+      const auto word = iend - ip >= 4 ? Read32(ip) : 0x808080u;
+      if ((word & 0x808080u) == 0)
+      {
+        triangles[i].idx[0] = index_fn(word & 0x7f);
+        triangles[i].idx[1] = index_fn((word >> 8) & 0x7f);
+        triangles[i].idx[2] = index_fn((word >> 16) & 0x7f);
+        ip += 3;
+        continue;
+      }
+
+      for (uint32_t j = 0; j < 3; ++j)
+      {
+        uint32_t code = 0;
+        for (uint32_t shift = 0;; shift += 7)
+        {
+          if (ip >= iend || shift > 28) return false;
+          const auto byte = *ip++;
+          code |= uint32_t(byte & 0x7f) << shift;
+          if ((byte & 0x80) == 0) break;
+        }
+
+        triangles[i].idx[j] = index_fn(code);
+      }
+    }
+
+    return ip == iend;
+  }
+
+
+  std::vector<uint8_t> CompressGeometry(std::pair<const void*, uint32_t> bytes, Raw::Layout layout, uint32_t chunk_size, uint32_t position_bits, uint32_t texcoord_bits)
+  {
+    const auto [data, size] = bytes;
+
+    std::vector<uint8_t> encoded;
+    switch (layout)
+    {
+    case Raw::LAYOUT_VERTEX:
+      encoded = EncodeVertices(reinterpret_cast<const Vertex*>(data), size / uint32_t(sizeof(Vertex)), position_bits, texcoord_bits);
+      break;
+    case Raw::LAYOUT_TRIANGLE:
+      encoded = EncodeTriangles(reinterpret_cast<const Triangle*>(data), size / uint32_t(sizeof(Triangle)));
+      break;
+    default:
+      throw std::runtime_error("unsupported geometry layout");
+    }
+
+    const auto packed = CompressChunks({ encoded.data(), uint32_t(encoded.size()) }, chunk_size);
+
+    const uint32_t header[] = { geometry_magic, uint32_t(layout), size };
+    std::vector<uint8_t> result(geometry_header + packed.size());
+    std::memcpy(result.data(), header, geometry_header);
+    std::memcpy(result.data() + geometry_header, packed.data(), packed.size());
+
+    return result;
+  }
+
+  bool IsCompressedGeometry(std::pair<const void*, uint32_t> bytes)
+  {
+    const auto [data, size] = bytes;
+    const auto src = reinterpret_cast<const uint8_t*>(data);
+
+    return size >= geometry_header && Read32(src) == geometry_magic
+      && IsCompressedChunks({ src + geometry_header, size - geometry_header });
+  }
+
+  Raw::Layout DecompressGeometry(std::pair<const void*, uint32_t> bytes, std::vector<uint8_t>& raw)
+  {
+    const auto [data, size] = bytes;
+    const auto src = reinterpret_cast<const uint8_t*>(data);
+
+    if (!IsCompressedGeometry(bytes))
+    {
+      throw std::runtime_error("geometry decoding failed");
+    }
+
+    // the header has to agree with the encoded streams before the raw is allocated
+    const auto layout = Raw::Layout(Read32(src + 4));
+    const auto raw_size = Read32(src + 8);
+    const auto stride = layout == Raw::LAYOUT_VERTEX ? uint32_t(sizeof(Vertex)) : layout == Raw::LAYOUT_TRIANGLE ? uint32_t(sizeof(Triangle)) : 0u;
+    if (stride == 0 || raw_size % stride != 0)
+    {
+      throw std::runtime_error("geometry decoding failed");
+    }
+    const auto count = raw_size / stride;
+
+    ChunkSource source(std::vector<uint8_t>(src + geometry_header, src + size));
+    const auto encoded_size = uint64_t(source.GetSize());
+
+    // vertex streams are a fixed size, each triangle index takes one to five bytes
+    const auto valid = layout == Raw::LAYOUT_VERTEX
+      ? encoded_size == vertex_header + uint64_t(raw_size)
+      : encoded_size >= sizeof(uint32_t) + 3 * uint64_t(count) && encoded_size <= sizeof(uint32_t) + 15 * uint64_t(count);
+    if (!valid)
+    {
+      throw std::runtime_error("geometry decoding failed");
+    }
+
+    // the count is in the first chunk, the raw is allocated only when it matches
+    std::vector<uint8_t> encoded(static_cast<size_t>(encoded_size));
+    source.Fetch(encoded.data(), 0, sizeof(uint32_t));
+    if (Read32(encoded.data()) != count)
+    {
+      throw std::runtime_error("geometry decoding failed");
+    }
+    source.Fetch(encoded.data(), 0, uint32_t(encoded.size()));
+    raw.resize(raw_size);
+
+    const auto decoded = layout == Raw::LAYOUT_VERTEX
+      ? DecodeVertices({ encoded.data(), uint32_t(encoded.size()) }, reinterpret_cast<Vertex*>(raw.data()), count)
+      : DecodeTriangles({ encoded.data(), uint32_t(encoded.size()) }, reinterpret_cast<Triangle*>(raw.data()), count);
+    if (!decoded)
+    {
+      raw.clear();
+      throw std::runtime_error("geometry decoding failed");
+    }
+
+    return layout;
+  }
+
+}
\ No newline at end of file
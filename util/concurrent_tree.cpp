@@ -0,0 +1,181 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "concurrent_tree.h"
+
+#include <thread>
+#include <limits>
+
+namespace RayGene3D
+{
+  ConcurrentTree::Reader ConcurrentTree::Read() const
+  {
+    const auto start = std::hash<std::thread::id>()(std::this_thread::get_id());
+    for (;;)
+    {
+      for (size_t i = 0; i < slots.size(); ++i)
+      {
+        auto& slot = slots[(start + i) % slots.size()];
+        if (slot.epoch.load(std::memory_order_relaxed) != 0) continue;
+
+        // entering before loading the root is what keeps the writer from freeing it
+        uint64_t expected = 0;
+        if (slot.epoch.compare_exchange_strong(expected, epoch.load()))
+        {
+          return Reader(&slot, published.load());
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  std::shared_ptr<Property> ConcurrentTree::Edit(const std::string& path)
+  {
+    if (!draft)
+    {
+      draft = Property::Clone(root);
+      privates.insert(draft.get());
+    }
+
+    auto node = draft;
+    size_t begin = 0;
+    while (begin < path.length())
+    {
+      auto end = path.find('/', begin);
+      if (end == std::string::npos) end = path.length();
+      const auto key = path.substr(begin, end - begin);
+      begin = end + 1;
+      if (key.empty()) continue;
+
+      // children are reached through the setters of the already private parent
+      std::shared_ptr<Property> child;
+      if (node->GetType() == Property::TYPE_OBJECT)
+      {
+        const auto& items = node->GetObjectItems();
+        const auto iter = items.find(key);
+        if (iter != items.end()) child = iter->second;
+      }
+      else if (node->GetType() == Property::TYPE_ARRAY)
+      {
+        char* tail = nullptr;
+        const auto index = std::strtoul(key.c_str(), &tail, 10);
+        if (*tail == '\0' && index < node->GetArraySize()) child = node->GetArrayItem(uint32_t(index));
+      }
+
+      if (!child)
+      {
+        throw std::runtime_error("edit failed");
+      }
+
+      // every node reachable from a published root may be in use by a reader
+      if (privates.find(child.get()) == privates.end())
+      {
+        child = Property::Clone(child);
+        privates.insert(child.get());
+        if (node->GetType() == Property::TYPE_OBJECT) node->SetObjectItem(key, child);
+        else node->SetArrayItem(uint32_t(std::strtoul(key.c_str(), nullptr, 10)), child);
+      }
+
+      node = child;
+    }
+
+    return node;
+  }
+
+  void ConcurrentTree::Share(const std::shared_ptr<Property>& node) const
+  {
+    if (!node || ((node->_epoch & Property::CONCURRENT) && privates.find(node.get()) == privates.end()))
+    {
+      return;
+    }
+
+    if (!(node->_epoch & Property::CONCURRENT))
+    {
+      const auto& value = node->_value;
+      uint32_t bits = 0;
+      if (std::holds_alternative<Property::bool_t>(value)) bits = Property::ToBits(std::get<Property::bool_t>(value));
+      else if (std::holds_alternative<Property::sint_t>(value)) bits = Property::ToBits(std::get<Property::sint_t>(value));
+      else if (std::holds_alternative<Property::uint_t>(value)) bits = Property::ToBits(std::get<Property::uint_t>(value));
+      else if (std::holds_alternative<Property::real_t>(value)) bits = Property::ToBits(std::get<Property::real_t>(value));
+      node->_hash.store(bits, std::memory_order_release);
+      node->_epoch |= Property::CONCURRENT;
+    }
+
+    if (node->GetType() == Property::TYPE_OBJECT)
+    {
+      for (const auto& [key, item] : node->GetObjectItems()) Share(item);
+    }
+    else if (node->GetType() == Property::TYPE_ARRAY)
+    {
+      for (uint32_t i = 0; i < node->GetArraySize(); ++i) Share(node->GetArrayItem(i));
+    }
+  }
+
+  void ConcurrentTree::Commit()
+  {
+    if (!draft)
+    {
+      return;
+    }
+
+    Share(draft);
+    published.store(draft.get());
+    // readers entering from this epoch on can only see the new root
+    const auto retire_epoch = epoch.fetch_add(1) + 1;
+    retired.push_back({ retire_epoch, std::move(root) });
+
+    root = std::move(draft);
+    privates.clear();
+
+    Reclaim();
+  }
+
+  void ConcurrentTree::Reclaim()
+  {
+    auto oldest = std::numeric_limits<uint64_t>::max();
+    for (const auto& slot : slots)
+    {
+      const auto entered = slot.epoch.load();
+      if (entered != 0) oldest = std::min(oldest, entered);
+    }
+
+    while (!retired.empty() && retired.front().first <= oldest)
+    {
+      retired.pop_front();
+    }
+  }
+
+  ConcurrentTree::ConcurrentTree(const std::shared_ptr<Property>& root, uint32_t readers)
+    : slots(std::max(1u, readers))
+    , published(root.get())
+    , root(root)
+  {
+    Share(root);
+  }
+}
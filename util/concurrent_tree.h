@@ -0,0 +1,111 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+#pragma once
+#include "property.h"
+
+#include <unordered_set>
+
+namespace RayGene3D
+{
+  // One writer and any number of readers sharing a property tree. A reader
+  // pins the published root with Read and walks it without locks or
+  // reference counting, using the Get* or Load* getters on scalar leaves,
+  // which every node of the tree publishes atomically. The writer
+  // updates scalars in place with Store*, and makes every other change on
+  // the nodes returned by Edit, which are private copies of the path, until
+  // Commit publishes the new root. Replaced nodes are released once no
+  // reader pinned before the commit is left (epoch-based reclamation).
+  class ConcurrentTree
+  {
+  protected:
+    struct alignas(64) Slot
+    {
+      std::atomic<uint64_t> epoch{ 0 };  // epoch the reader entered with, 0 when free
+    };
+
+  public:
+    class Reader
+    {
+      friend class ConcurrentTree;
+
+    protected:
+      Slot* slot{ nullptr };
+      const Property* root{ nullptr };
+
+    public:
+      const Property& operator*() const { return *root; }
+      const Property* operator->() const { return root; }
+      const Property* Get() const { return root; }
+
+    public:
+      Reader(Reader&& other) noexcept : slot(std::exchange(other.slot, nullptr)), root(other.root) {}
+      Reader(const Reader&) = delete;
+      Reader& operator=(const Reader&) = delete;
+      Reader& operator=(Reader&&) = delete;
+
+    protected:
+      Reader(Slot* slot, const Property* root) : slot(slot), root(root) {}
+
+    public:
+      ~Reader() { if (slot) slot->epoch.store(0, std::memory_order_release); }
+    };
+
+  protected:
+    mutable std::vector<Slot> slots;
+    std::atomic<uint64_t> epoch{ 1 };
+    std::atomic<const Property*> published{ nullptr };
+
+  protected:
+    std::shared_ptr<Property> root;
+    std::shared_ptr<Property> draft;
+    std::unordered_set<const Property*> privates;
+    std::deque<std::pair<uint64_t, std::shared_ptr<Property>>> retired;
+
+  protected:
+    // marks the nodes a reader can reach, stopping at the ones already marked and not private
+    void Share(const std::shared_ptr<Property>& node) const;
+
+  public:
+    // never blocks unless more readers than slots are pinned at once
+    Reader Read() const;
+
+  public:
+    const std::shared_ptr<Property>& GetRoot() const { return root; }
+    // private copy of the node at the '/'-separated path of the next root
+    std::shared_ptr<Property> Edit(const std::string& path);
+    void Commit();
+    // frees the roots no reader can see any more, also done by Commit
+    void Reclaim();
+    uint32_t GetRetired() const { return uint32_t(retired.size()); }
+
+  public:
+    ConcurrentTree(const std::shared_ptr<Property>& root, uint32_t readers = 64);
+    ~ConcurrentTree() {}
+  };
+}
@@ -0,0 +1,346 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "job_system.h"
+
+#include <algorithm>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace RayGene3D
+{
+  namespace
+  {
+    thread_local JobSystem* worker_system = nullptr;
+    thread_local uint32_t worker_index = 0;
+  }
+
+  std::atomic<JobSystem*> JobSystem::current{ nullptr };
+
+  void JobSystem::Group::Run(task_t task)
+  {
+    pending += 1;
+    try
+    {
+      system.Push({ std::move(task), this });
+    }
+    catch (...)
+    {
+      pending -= 1;
+      throw;
+    }
+  }
+
+  void JobSystem::Group::Wait()
+  {
+    system.Help(*this);
+
+    std::exception_ptr thrown;
+    {
+      std::lock_guard<std::mutex> lock(exception_mutex);
+      std::swap(thrown, exception);
+    }
+    if (thrown)
+    {
+      std::rethrow_exception(thrown);
+    }
+  }
+
+  JobSystem::Group::~Group()
+  {
+    system.Help(*this);
+  }
+
+  void JobSystem::Push(Task task)
+  {
+    // workers may still push while they drain, outside threads may not once Stop began
+    const auto outside = worker_system != this;
+    if (outside)
+    {
+      pushing += 1;
+      if (closed)
+      {
+        pushing -= 1;
+        throw std::runtime_error("job system stopped");
+      }
+    }
+
+    if (queues.empty())
+    {
+      if (outside) pushing -= 1;
+      Execute(task);
+      return;
+    }
+
+    const auto index = outside ? uint32_t(queues.size() - 1) : worker_index;
+    const auto group = task.group;
+    {
+      std::lock_guard<std::mutex> lock(queues[index]->mutex);
+      queues[index]->tasks.push_back(std::move(task));
+      if (group) group->queued += 1;
+      queued += 1;
+    }
+    if (outside) pushing -= 1;
+
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+    }
+    // a waiter of the group sleeps on the same condition as the idle workers
+    if (group) sleep_condition.notify_all();
+    else sleep_condition.notify_one();
+  }
+
+  bool JobSystem::Pop(uint32_t index, Task& task, const Group* group)
+  {
+    auto& queue = *queues[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    // the group's latest task, which may sit below tasks of nested groups
+    const auto iter = std::find_if(queue.tasks.rbegin(), queue.tasks.rend(),
+      [group](const Task& queued_task) { return !group || queued_task.group == group; });
+    if (iter == queue.tasks.rend())
+    {
+      return false;
+    }
+
+    task = std::move(*iter);
+    queue.tasks.erase(std::next(iter).base());
+    if (task.group) task.group->queued -= 1;
+    queued -= 1;
+    return true;
+  }
+
+  bool JobSystem::Steal(uint32_t index, Task& task, const Group* group)
+  {
+    const auto count = uint32_t(queues.size());
+    for (uint32_t i = 1; i <= count; ++i)
+    {
+      auto& queue = *queues[(index + i) % count];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+
+      const auto iter = std::find_if(queue.tasks.begin(), queue.tasks.end(),
+        [group](const Task& queued_task) { return !group || queued_task.group == group; });
+      if (iter == queue.tasks.end()) continue;
+
+      task = std::move(*iter);
+      queue.tasks.erase(iter);
+      if (task.group) task.group->queued -= 1;
+      queued -= 1;
+      return true;
+    }
+    return false;
+  }
+
+  void JobSystem::Execute(Task& task)
+  {
+    try
+    {
+      task.fn();
+    }
+    catch (...)
+    {
+      if (!task.group) throw;
+
+      std::lock_guard<std::mutex> lock(task.group->exception_mutex);
+      if (!task.group->exception) task.group->exception = std::current_exception();
+    }
+
+    if (task.group && --task.group->pending == 0)
+    {
+      // a waiter may be asleep on the group
+      {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+      }
+      sleep_condition.notify_all();
+    }
+  }
+
+  void JobSystem::Help(const Group& group)
+  {
+    while (group.pending != 0)
+    {
+      if (RunOne(&group)) continue;
+
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      sleep_condition.wait(lock, [&group]() { return group.pending == 0 || group.queued != 0; });
+    }
+  }
+
+  bool JobSystem::RunOne()
+  {
+    if (queues.empty() || queued == 0)
+    {
+      return false;
+    }
+
+    Task task;
+    const auto index = worker_system == this ? worker_index : uint32_t(queues.size() - 1);
+    if (!Pop(index, task) && !Steal(index, task))
+    {
+      return false;
+    }
+
+    Execute(task);
+    return true;
+  }
+
+  bool JobSystem::RunOne(const Group* group)
+  {
+    if (queues.empty() || queued == 0)
+    {
+      return false;
+    }
+
+    Task task;
+    const auto index = worker_system == this ? worker_index : uint32_t(queues.size() - 1);
+    if (!Pop(index, task, group) && !Steal(index, task, group))
+    {
+      return false;
+    }
+
+    Execute(task);
+    return true;
+  }
+
+  void JobSystem::Work(uint32_t index, bool pin)
+  {
+#ifdef __linux__
+    if (pin)
+    {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(index % std::max(1u, std::thread::hardware_concurrency()), &set);
+      pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+
+    worker_system = this;
+    worker_index = index;
+
+    while (true)
+    {
+      Task task;
+      if (Pop(index, task) || Steal(index, task))
+      {
+        Execute(task);
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(sleep_mutex);
+      sleep_condition.wait(lock, [this]() { return stopping || queued != 0; });
+      if (stopping && queued == 0) break;
+    }
+
+    worker_system = nullptr;
+  }
+
+  void JobSystem::Start(uint32_t count, bool pin)
+  {
+    if (IsRunning())
+    {
+      throw std::runtime_error("job system already started");
+    }
+
+    if (count == 0)
+    {
+      count = std::max(1u, std::thread::hardware_concurrency()) - 1;
+      count = std::max(1u, count);
+    }
+
+    closed = false;
+    stopping = false;
+    for (uint32_t i = 0; i <= count; ++i)
+    {
+      queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    for (uint32_t i = 0; i < count; ++i)
+    {
+      threads.emplace_back(&JobSystem::Work, this, i, pin);
+    }
+  }
+
+  void JobSystem::Stop()
+  {
+    if (!IsRunning())
+    {
+      return;
+    }
+
+    // pushes that got past the check finish before the workers may exit
+    closed = true;
+    while (pushing != 0) std::this_thread::yield();
+
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex);
+      stopping = true;
+    }
+    sleep_condition.notify_all();
+
+    // workers drain every queue before they exit
+    for (auto& thread : threads) thread.join();
+    threads.clear();
+    queues.clear();
+  }
+
+  void JobSystem::For(uint32_t count, const std::function<void(uint32_t)>& fn)
+  {
+    if (const auto system = GetCurrent())
+    {
+      system->ParallelFor(0, count, 1, [&fn](uint32_t begin, uint32_t end) { for (auto i = begin; i < end; ++i) fn(i); });
+      return;
+    }
+
+    const auto threads = std::min(count, std::max(1u, std::thread::hardware_concurrency()));
+    if (threads <= 1)
+    {
+      for (uint32_t i = 0; i < count; ++i) fn(i);
+      return;
+    }
+
+    std::atomic<uint32_t> next{ 0 };
+    const auto worker_fn = [&next, &fn, count]()
+    {
+      for (auto i = next++; i < count; i = next++) fn(i);
+    };
+
+    std::vector<std::thread> workers(threads - 1);
+    for (auto& worker : workers) worker = std::thread(worker_fn);
+    worker_fn();
+    for (auto& worker : workers) worker.join();
+  }
+
+  JobSystem::~JobSystem()
+  {
+    if (GetCurrent() == this) SetCurrent(nullptr);
+    Stop();
+  }
+}
@@ -0,0 +1,172 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+#pragma once
+#include "types.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace RayGene3D
+{
+  // Work-stealing pool: every worker owns a deque it pushes to and pops from
+  // at the back, idle workers steal from the front of the others. Tasks
+  // submitted from outside the pool go to a shared injection deque. A thread
+  // waiting on a group runs or steals only that group's pending tasks and
+  // sleeps when there are none, so groups may nest and a waiter never picks
+  // up unrelated work while it might be holding a lock. Once Stop has begun,
+  // tasks pushed from outside the pool are rejected.
+  class JobSystem
+  {
+  public:
+    typedef std::function<void()> task_t;
+
+  public:
+    class Group
+    {
+      friend class JobSystem;
+
+    protected:
+      JobSystem& system;
+      std::atomic<uint32_t> pending{ 0 };
+      std::atomic<uint32_t> queued{ 0 };  // pending tasks nobody has taken yet
+      std::exception_ptr exception;
+      std::mutex exception_mutex;
+
+    public:
+      void Run(task_t task);
+      // rethrows the first exception thrown by a task of the group
+      void Wait();
+      bool IsDone() const { return pending == 0; }
+
+    public:
+      Group(JobSystem& system) : system(system) {}
+      ~Group();
+    };
+
+  protected:
+    struct Task
+    {
+      task_t fn;
+      Group* group{ nullptr };
+    };
+
+    struct Queue
+    {
+      std::deque<Task> tasks;
+      std::mutex mutex;
+    };
+
+  protected:
+    std::vector<std::unique_ptr<Queue>> queues;  // one per worker, the last one is the injection queue
+    std::vector<std::thread> threads;
+    std::atomic<uint32_t> queued{ 0 };
+    std::atomic<uint32_t> pushing{ 0 };
+    std::atomic<bool> closed{ false };
+    std::atomic<bool> stopping{ false };
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_condition;
+
+  protected:
+    static std::atomic<JobSystem*> current;
+
+  protected:
+    void Push(Task task);
+    bool Pop(uint32_t index, Task& task, const Group* group = nullptr);
+    bool Steal(uint32_t index, Task& task, const Group* group = nullptr);
+    void Execute(Task& task);
+    void Help(const Group& group);
+    void Work(uint32_t index, bool pin);
+
+  public:
+    // count of 0 uses one worker less than the hardware threads, as the caller helps
+    void Start(uint32_t count = 0, bool pin = false);
+    void Stop();
+    bool IsRunning() const { return !threads.empty(); }
+    uint32_t GetWorkerCount() const { return uint32_t(threads.size()); }
+
+  public:
+    // fire and forget, an exception escaping the task terminates
+    void Submit(task_t task) { Push({ std::move(task), nullptr }); }
+
+  public:
+    // runs one pending task on the calling thread, false if there was none
+    bool RunOne();
+    // runs one of the group's pending tasks, from this thread's deque first
+    bool RunOne(const Group* group);
+
+  public:
+    // fn(begin, end) is called for consecutive chunks of at most grain items
+    template<typename F>
+    void ParallelFor(uint32_t begin, uint32_t end, uint32_t grain, F&& fn)
+    {
+      if (begin >= end) return;
+      grain = std::max(1u, grain);
+
+      Group group(*this);
+      for (auto chunk = begin + grain; chunk < end; chunk += std::min(grain, end - chunk))
+      {
+        const auto chunk_end = chunk + std::min(grain, end - chunk);
+        group.Run([&fn, chunk, chunk_end]() { fn(chunk, chunk_end); });
+      }
+      fn(begin, std::min(end, begin + grain));
+      group.Wait();
+    }
+
+    // map(begin, end) reduces one chunk, reduce(a, b) combines chunk results in order
+    template<typename T, typename M, typename R>
+    T ParallelReduce(uint32_t begin, uint32_t end, uint32_t grain, T identity, M&& map, R&& reduce)
+    {
+      if (begin >= end) return identity;
+      grain = std::max(1u, grain);
+
+      std::vector<T> partials((end - begin + grain - 1) / grain, identity);
+      ParallelFor(begin, end, grain, [&map, &partials, begin, grain](uint32_t chunk_begin, uint32_t chunk_end)
+        {
+          partials[(chunk_begin - begin) / grain] = map(chunk_begin, chunk_end);
+        });
+
+      auto result = identity;
+      for (auto& partial : partials) result = reduce(result, partial);
+      return result;
+    }
+
+  public:
+    // the pool library code runs on, null when no pool is started
+    static JobSystem* GetCurrent() { return current; }
+    static void SetCurrent(JobSystem* system) { current = system; }
+
+    // runs fn(i) for every index on the current pool, or on temporary threads without one
+    static void For(uint32_t count, const std::function<void(uint32_t)>& fn);
+
+  public:
+    JobSystem() {}
+    ~JobSystem();
+  };
+}
@@ -29,6 +29,8 @@ THE SOFTWARE.
 
 #include "property.h"
 
+#include <unordered_set>
+
 //#define TINYOBJLOADER_IMPLEMENTATION
 //#include <tinyobjloader/tiny_obj_loader.h>
 
@@ -55,8 +57,22 @@ THE SOFTWARE.
 
 namespace RayGene3D
 {
+  Property::Type Property::GetType() const
+  {
+    if (std::holds_alternative<bool_t>(_value)) return TYPE_BOOL;
+    if (std::holds_alternative<real_t>(_value)) return TYPE_REAL;
+    if (std::holds_alternative<sint_t>(_value)) return TYPE_SINT;
+    if (std::holds_alternative<uint_t>(_value)) return TYPE_UINT;
+    if (std::holds_alternative<string_t>(_value)) return TYPE_STRING;
+    if (std::holds_alternative<object_t>(_value)) return TYPE_OBJECT;
+    if (std::holds_alternative<array_t>(_value)) return TYPE_ARRAY;
+    if (std::holds_alternative<raw_t>(_value)) return TYPE_RAW;
+    return TYPE_UNDEFINED;
+  }
+
   void Property::FromFMat3x4(const glm::f32mat3x4& mat)
   {
+    Touch();
     for (uint32_t i = 0; i < 3; ++i)
     {
       for (uint32_t j = 0; j < 4; ++j)
@@ -68,6 +84,7 @@ namespace RayGene3D
 
   void Property::FromFVec4(const glm::f32vec4& vec)
   {
+    Touch();
     for (uint32_t i = 0; i < 4; ++i)
     {
       this->GetArrayItem(i)->SetReal(vec[i]);
@@ -76,6 +93,7 @@ namespace RayGene3D
 
   void Property::FromFVec3(const glm::f32vec3& vec)
   {
+    Touch();
     for (uint32_t i = 0; i < 3; ++i)
     {
       this->GetArrayItem(i)->SetReal(vec[i]);
@@ -84,6 +102,7 @@ namespace RayGene3D
 
   void Property::FromFVec2(const glm::f32vec2& vec)
   {
+    Touch();
     for (uint32_t i = 0; i < 2; ++i)
     {
       this->GetArrayItem(i)->SetReal(vec[i]);
@@ -92,11 +111,13 @@ namespace RayGene3D
 
   void Property::FromFloat(float value)
   {
+    Touch();
     this->SetReal(value);
   }
 
   void Property::FromUVec4(const glm::u32vec4& vec)
   {
+    Touch();
     for (uint32_t i = 0; i < 4; ++i)
     {
       this->GetArrayItem(i)->SetUint(vec[i]);
@@ -105,6 +126,7 @@ namespace RayGene3D
 
   void Property::FromUVec3(const glm::u32vec3& vec)
   {
+    Touch();
     for (uint32_t i = 0; i < 3; ++i)
     {
       this->GetArrayItem(i)->SetUint(vec[i]);
@@ -113,6 +135,7 @@ namespace RayGene3D
 
   void Property::FromUVec2(const glm::u32vec2& vec)
   {
+    Touch();
     for (uint32_t i = 0; i < 2; ++i)
     {
       this->GetArrayItem(i)->SetUint(vec[i]);
@@ -121,6 +144,7 @@ namespace RayGene3D
 
   void Property::FromUInt(uint32_t value)
   {
+    Touch();
     this->SetUint(value);
   }
 
@@ -215,7 +239,143 @@ namespace RayGene3D
   }
 
 
-  nlohmann::json Property::ToJSON(const std::shared_ptr<Property>& property, std::map<std::shared_ptr<Property>, std::string>& binaries)
+  namespace
+  {
+    const std::string inline_prefix = "data:application/octet-stream;base64,";
+    const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  }
+
+  bool Property::IsInline(const std::string& value)
+  {
+    return value.compare(0, inline_prefix.length(), inline_prefix) == 0;
+  }
+
+  std::string Property::EncodeInline(const raw_t& raw)
+  {
+    const auto [bytes, size] = raw.GetBytes(0);
+    const auto data = reinterpret_cast<const uint8_t*>(bytes);
+
+    auto encode = inline_prefix;
+    encode.reserve(inline_prefix.length() + (size + 2) / 3 * 4);
+    for (uint32_t i = 0; i < size; i += 3)
+    {
+      const auto count = std::min(3u, size - i);
+      const auto triple = (uint32_t(data[i]) << 16) | (count > 1 ? uint32_t(data[i + 1]) << 8 : 0) | (count > 2 ? uint32_t(data[i + 2]) : 0);
+      encode.push_back(base64_alphabet[(triple >> 18) & 63]);
+      encode.push_back(base64_alphabet[(triple >> 12) & 63]);
+      encode.push_back(count > 1 ? base64_alphabet[(triple >> 6) & 63] : '=');
+      encode.push_back(count > 2 ? base64_alphabet[triple & 63] : '=');
+    }
+
+    return encode;
+  }
+
+  bool Property::DecodeInline(const std::string& value, const std::shared_ptr<Property>& property)
+  {
+    if (!IsInline(value) || (value.length() - inline_prefix.length()) % 4 != 0)
+    {
+      return false;
+    }
+
+    std::vector<uint8_t> data;
+    data.reserve((value.length() - inline_prefix.length()) / 4 * 3);
+
+    uint32_t triple = 0;
+    uint32_t count = 0;
+    for (auto i = inline_prefix.length(); i < value.length(); ++i)
+    {
+      const auto symbol = value[i];
+      if (symbol == '=')
+      {
+        break;
+      }
+
+      const auto position = std::strchr(base64_alphabet, symbol);
+      if (position == nullptr || symbol == '\0')
+      {
+        return false;
+      }
+
+      triple = (triple << 6) | uint32_t(position - base64_alphabet);
+      if (++count == 4)
+      {
+        data.push_back(uint8_t(triple >> 16));
+        data.push_back(uint8_t(triple >> 8));
+        data.push_back(uint8_t(triple));
+        triple = 0;
+        count = 0;
+      }
+    }
+    if (count == 3)
+    {
+      data.push_back(uint8_t(triple >> 10));
+      data.push_back(uint8_t(triple >> 2));
+    }
+    else if (count == 2)
+    {
+      data.push_back(uint8_t(triple >> 4));
+    }
+
+    // an existing allocation of the same size is overwritten in place
+    const auto size = uint32_t(data.size());
+    const auto current = property->GetRawSize();
+    if (current != size)
+    {
+      if (current != 0) property->RawFree();
+      property->RawAllocate(size);
+    }
+    property->SetRawBytes({ data.data(), size }, 0);
+
+    return true;
+  }
+
+  bool Property::IsHash(const std::string& value)
+  {
+    if (value.length() != 48)
+    {
+      return false;
+    }
+
+    const auto hex_fn = [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); };
+    for (size_t i = 0; i < 48; i += 3)
+    {
+      if (value[i] != '-' || !hex_fn(value[i + 1]) || !hex_fn(value[i + 2])) return false;
+    }
+    return true;
+  }
+
+  std::string Property::EncodeHash(const raw_t& raw)
+  {
+    const auto [bytes, size] = raw.GetBytes(0);
+
+    RAYGENE3D_TRACE(scope, "property.md5");
+    RAYGENE3D_TRACE_BYTES(scope, size);
+    digestpp::md5 hash_provider;
+    const auto hash = hash_provider.absorb((uint8_t*)bytes, size).hexdigest();
+
+    auto encode = std::string().assign(hash.length() + hash.length() / 2, '-');
+    for (size_t i = 0; i < hash.length() / 2; ++i)
+    {
+      encode[3 * i + 1] = hash[2 * i + 0];
+      encode[3 * i + 2] = hash[2 * i + 1];
+    }
+
+    return encode;
+  }
+
+  nlohmann::json Property::ToJSON(const std::shared_ptr<Property>& property, std::map<std::shared_ptr<Property>, std::string>& binaries, uint32_t inline_limit)
+  {
+    RAYGENE3D_TRACE(scope, "property.to_json");
+    return ToJSONNode(property, binaries, inline_limit);
+  }
+
+  std::shared_ptr<Property> Property::FromJSON(const nlohmann::json& node, std::map<std::shared_ptr<Property>, std::string>& binaries)
+  {
+    RAYGENE3D_TRACE(scope, "property.from_json");
+    return FromJSONNode(node, binaries);
+  }
+
+  nlohmann::json Property::ToJSONNode(const std::shared_ptr<Property>& property, std::map<std::shared_ptr<Property>, std::string>& binaries, uint32_t inline_limit)
   {
     nlohmann::json json;
 
@@ -252,7 +412,7 @@ namespace RayGene3D
       {
         if (value)
         {
-          json[key] = ToJSON(value, binaries);
+          json[key] = ToJSONNode(value, binaries, inline_limit);
         }
       }
       break;
@@ -263,26 +423,22 @@ namespace RayGene3D
       {
         if (value)
         {
-          json.push_back(ToJSON(value, binaries));
+          json.push_back(ToJSONNode(value, binaries, inline_limit));
         }
       }
       break;
     }
     case 8:
     {
-      const auto& raw = std::get<8>(property->_value);
-      const auto [bytes, size] = raw.GetBytes(0);
-
-      digestpp::md5 hash_provider;
-      const auto hash = hash_provider.absorb((uint8_t*)bytes, size).hexdigest();
-
-      auto encode = std::string().assign(hash.length() + hash.length() / 2, '-');
-      for (size_t i = 0; i < hash.length() / 2; ++i)
+      // small payloads are embedded in the document instead of a sidecar
+      if (std::get<8>(property->_value).GetSize() < inline_limit)
       {
-        encode[3 * i + 1] = hash[2 * i + 0];
-        encode[3 * i + 2] = hash[2 * i + 1];
+        json = EncodeInline(std::get<8>(property->_value));
+        break;
       }
 
+      const auto encode = EncodeHash(std::get<8>(property->_value));
+
       json = encode;
 
       binaries[property] = encode;
@@ -294,7 +450,7 @@ namespace RayGene3D
     return json;
   }
 
-  std::shared_ptr<Property> Property::FromJSON(const nlohmann::json& node, std::map<std::shared_ptr<Property>, std::string>& binaries)
+  std::shared_ptr<Property> Property::FromJSONNode(const nlohmann::json& node, std::map<std::shared_ptr<Property>, std::string>& binaries)
   {
     std::shared_ptr<Property> property;
 
@@ -310,7 +466,7 @@ namespace RayGene3D
       property.reset(new Property(TYPE_OBJECT));
       for (auto it = node.begin(); it != node.end(); ++it)
       {
-        auto child = FromJSON(it.value(), binaries);
+        auto child = FromJSONNode(it.value(), binaries);
         if (child)
         {
           property->SetObjectItem(it.key(), child);
@@ -324,7 +480,7 @@ namespace RayGene3D
       property->SetArraySize(static_cast<uint32_t>(node.size()));
       for (uint32_t i = 0; i < static_cast<uint32_t>(node.size()); ++i)
       {
-        auto child = FromJSON(node[i], binaries);
+        auto child = FromJSONNode(node[i], binaries);
         if (child)
         {
           property->SetArrayItem(i, child);
@@ -335,9 +491,18 @@ namespace RayGene3D
     case nlohmann::json::value_t::string:
     {
       const auto value = std::string(node);
-      if (value.length() == 48)
+      if (IsInline(value))
       {
-        if (std::regex_match(value, std::regex("^(-[a-f0-9][a-f0-9]){16}$")))
+        property.reset(new Property(TYPE_RAW));
+        if (!DecodeInline(value, property))
+        {
+          property.reset(new Property(TYPE_STRING));
+          property->SetString(value);
+        }
+      }
+      else if (value.length() == 48)
+      {
+        if (IsHash(value))
         {
           property.reset(new Property(TYPE_RAW));
           binaries[property] = value;
@@ -383,6 +548,887 @@ namespace RayGene3D
     return property;
   }
 
+  std::shared_ptr<Property> Property::Reconcile(const nlohmann::json& node, const std::shared_ptr<Property>& property, std::map<std::shared_ptr<Property>, std::string>& binaries, Summary& summary,
+    const std::set<std::string>& touched)
+  {
+    const auto epoch = property ? GetEpoch(property) : 0;
+    return ReconcileNode(node, property, epoch, property && (property->_epoch & (FROZEN | SHARED)), touched, binaries, summary);
+  }
+
+  // a shared node is never written, its private copy is handed back to the parent instead
+  std::shared_ptr<Property> Property::ReconcileNode(const nlohmann::json& node, const std::shared_ptr<Property>& property, uint32_t epoch, bool shared,
+    const std::set<std::string>& touched, std::map<std::shared_ptr<Property>, std::string>& binaries, Summary& summary)
+  {
+    const auto replace_fn = [&node, &property, &binaries, &summary]()
+    {
+      auto created = FromJSON(node, binaries);
+      if (property) summary.removed += 1;
+      if (created) { summary.added += 1; summary.changes.push_back(created); }
+      return created;
+    };
+
+    const auto target_fn = [&property, epoch, shared]()
+    {
+      return shared ? Privatize(property, epoch) : property;
+    };
+
+    const auto changed_fn = [&summary, shared](const std::shared_ptr<Property>& target)
+    {
+      summary.changes.push_back(target);
+      return shared ? target : nullptr;
+    };
+
+    if (!property)
+    {
+      return replace_fn();
+    }
+
+    switch (node.type())
+    {
+    case nlohmann::json::value_t::object:
+    {
+      if (!std::holds_alternative<object_t>(property->_value))
+      {
+        return replace_fn();
+      }
+
+      const auto& items = std::get<object_t>(property->_value);
+      std::vector<std::string> removals;
+      for (const auto& [key, item] : items)
+      {
+        if (!node.contains(key)) removals.push_back(key);
+      }
+      summary.removed += uint32_t(removals.size());
+
+      std::vector<std::pair<std::string, std::shared_ptr<Property>>> replacements;
+      for (auto it = node.begin(); it != node.end(); ++it)
+      {
+        const auto iter = items.find(it.key());
+        const auto found = iter != items.end() && iter->second;
+        const auto private_item = found && !shared && !IsShared(iter->second, epoch);
+        const auto replacement = ReconcileNode(it.value(), found ? iter->second : nullptr, epoch, found && !private_item, touched, binaries, summary);
+        if (replacement) replacements.push_back({ it.key(), replacement });
+        else if (iter != items.end() && !found) removals.push_back(it.key());
+      }
+
+      if (removals.empty() && replacements.empty())
+      {
+        return nullptr;
+      }
+
+      const auto target = target_fn();
+      auto& target_items = std::get<object_t>(target->_value);
+      for (const auto& key : removals) target_items.erase(key);
+      for (const auto& [key, item] : replacements) target_items[key] = item;
+      target->Touch();
+      return changed_fn(target);
+    }
+    case nlohmann::json::value_t::array:
+    {
+      if (!std::holds_alternative<array_t>(property->_value))
+      {
+        return replace_fn();
+      }
+
+      const auto& items = std::get<array_t>(property->_value);
+      const auto size = uint32_t(node.size());
+      std::vector<std::pair<uint32_t, std::shared_ptr<Property>>> replacements;
+      for (uint32_t i = 0; i < size; ++i)
+      {
+        const auto found = i < items.size() && items[i];
+        const auto private_item = found && !shared && !IsShared(items[i], epoch);
+        const auto replacement = ReconcileNode(node[i], found ? items[i] : nullptr, epoch, found && !private_item, touched, binaries, summary);
+        if (replacement) replacements.push_back({ i, replacement });
+      }
+
+      if (items.size() == size && replacements.empty())
+      {
+        return nullptr;
+      }
+
+      if (items.size() > size) summary.removed += uint32_t(items.size()) - size;
+      const auto target = target_fn();
+      auto& target_items = std::get<array_t>(target->_value);
+      target_items.resize(size);
+      for (const auto& [index, item] : replacements) target_items[index] = item;
+      target->Touch();
+      return changed_fn(target);
+    }
+    case nlohmann::json::value_t::string:
+    {
+      const auto& value = node.get_ref<const std::string&>();
+      if (IsHash(value))
+      {
+        if (!std::holds_alternative<raw_t>(property->_value))
+        {
+          return replace_fn();
+        }
+
+        // only raws whose content differs are handed back for reading; a backed
+        // raw is known by its sidecar, so evicted payloads are not paged in to be hashed
+        const auto& raw = std::get<raw_t>(property->_value);
+        const auto origin = raw.GetOrigin();
+        const auto same = origin.empty() ? EncodeHash(raw) == value
+          : origin.length() >= value.length() && origin.compare(origin.length() - value.length(), value.length(), value) == 0;
+        if (!same || touched.count(value) != 0)
+        {
+          const auto target = target_fn();
+          binaries[target] = value;
+          summary.updated += 1;
+          return changed_fn(target);
+        }
+        return nullptr;
+      }
+
+      if (IsInline(value) && std::holds_alternative<raw_t>(property->_value))
+      {
+        if (EncodeInline(std::get<raw_t>(property->_value)) != value)
+        {
+          const auto target = target_fn();
+          const auto size = target->GetRawSize();
+          if (DecodeInline(value, target) && target->GetRawSize() == size) summary.reused += 1;
+          summary.updated += 1;
+          return changed_fn(target);
+        }
+        return nullptr;
+      }
+      if (IsInline(value))
+      {
+        return replace_fn();
+      }
+
+      if (!std::holds_alternative<string_t>(property->_value))
+      {
+        return replace_fn();
+      }
+      if (property->GetString() != value)
+      {
+        const auto target = target_fn();
+        target->SetString(value);
+        summary.updated += 1;
+        return changed_fn(target);
+      }
+      return nullptr;
+    }
+    case nlohmann::json::value_t::boolean:
+    {
+      if (!std::holds_alternative<bool_t>(property->_value)) return replace_fn();
+      if (property->GetBool() == bool_t(node)) return nullptr;
+      const auto target = target_fn();
+      target->SetBool(node);
+      summary.updated += 1;
+      return changed_fn(target);
+    }
+    case nlohmann::json::value_t::number_integer:
+    {
+      if (!std::holds_alternative<sint_t>(property->_value)) return replace_fn();
+      if (property->GetSint() == sint_t(node)) return nullptr;
+      const auto target = target_fn();
+      target->SetSint(node);
+      summary.updated += 1;
+      return changed_fn(target);
+    }
+    case nlohmann::json::value_t::number_unsigned:
+    {
+      if (!std::holds_alternative<uint_t>(property->_value)) return replace_fn();
+      if (property->GetUint() == uint_t(node)) return nullptr;
+      const auto target = target_fn();
+      target->SetUint(node);
+      summary.updated += 1;
+      return changed_fn(target);
+    }
+    case nlohmann::json::value_t::number_float:
+    {
+      if (!std::holds_alternative<real_t>(property->_value)) return replace_fn();
+      if (property->GetReal() == real_t(node)) return nullptr;
+      const auto target = target_fn();
+      target->SetReal(node);
+      summary.updated += 1;
+      return changed_fn(target);
+    }
+    case nlohmann::json::value_t::null:
+    {
+      if (!std::holds_alternative<undefined_t>(property->_value)) return replace_fn();
+      return nullptr;
+    }
+    default:
+    {
+      return nullptr;
+    }
+    }
+  }
+
+  std::atomic<uint32_t> Property::epoch{ 0 };
+
+  std::shared_ptr<Property> Property::Clone(const std::shared_ptr<Property>& property)
+  {
+    auto clone = std::shared_ptr<Property>(new Property(TYPE_UNDEFINED));
+    clone->Count(-1);
+
+    if (std::holds_alternative<bool_t>(property->_value)) clone->_value = std::get<bool_t>(property->_value);
+    else if (std::holds_alternative<sint_t>(property->_value)) clone->_value = std::get<sint_t>(property->_value);
+    else if (std::holds_alternative<uint_t>(property->_value)) clone->_value = std::get<uint_t>(property->_value);
+    else if (std::holds_alternative<real_t>(property->_value)) clone->_value = std::get<real_t>(property->_value);
+    else if (std::holds_alternative<string_t>(property->_value)) clone->_value = std::get<string_t>(property->_value);
+    else if (std::holds_alternative<object_t>(property->_value)) clone->_value = std::get<object_t>(property->_value);
+    else if (std::holds_alternative<array_t>(property->_value)) clone->_value = std::get<array_t>(property->_value);
+    else if (std::holds_alternative<raw_t>(property->_value))
+    {
+      clone->_value.emplace<raw_t>();
+      const auto [bytes, size] = property->GetRawBytes(0);
+      clone->SetRawLayout(property->GetRawLayout());
+      if (const auto policy = std::get<raw_t>(property->_value).GetPolicy()) clone->SetRawPolicy(*policy);
+      if (size != 0)
+      {
+        clone->RawAllocate(size);
+        clone->SetRawBytes({ bytes, size }, 0);
+      }
+    }
+
+    clone->Count(1);
+    clone->_epoch = property->_epoch & CONCURRENT;
+
+    // the copy shares the children, so a container hash or a published scalar stays valid
+    if (!std::holds_alternative<raw_t>(property->_value))
+    {
+      clone->_hash_stamp = property->_hash_stamp.load();
+      clone->_hash = property->_hash.load();
+    }
+
+    return clone;
+  }
+
+  // both roots get a fresh epoch, so no node below either of them is private to it
+  std::shared_ptr<Property> Property::Snapshot(const std::shared_ptr<Property>& root)
+  {
+    auto snapshot = Clone(root);
+    snapshot->_epoch |= NextEpoch();
+    root->_epoch = (root->_epoch & ~EPOCH_MASK) | NextEpoch();
+
+    if (std::holds_alternative<object_t>(root->_value))
+    {
+      for (const auto& [key, item] : std::get<object_t>(root->_value)) Share(item);
+    }
+    else if (std::holds_alternative<array_t>(root->_value))
+    {
+      for (const auto& item : std::get<array_t>(root->_value)) Share(item);
+    }
+    return snapshot;
+  }
+
+  // marked nodes are only ever replaced by copies, so everything below one is marked already
+  void Property::Share(const std::shared_ptr<Property>& property)
+  {
+    if (!property || (property->_epoch & (FROZEN | CONCURRENT | SHARED)))
+    {
+      return;
+    }
+    property->_epoch |= SHARED;
+
+    if (std::holds_alternative<object_t>(property->_value))
+    {
+      for (const auto& [key, item] : std::get<object_t>(property->_value)) Share(item);
+    }
+    else if (std::holds_alternative<array_t>(property->_value))
+    {
+      for (const auto& item : std::get<array_t>(property->_value)) Share(item);
+    }
+  }
+
+  uint32_t Property::GetEpoch(const std::shared_ptr<Property>& root)
+  {
+    if ((root->_epoch & EPOCH_MASK) == 0)
+    {
+      root->_epoch |= NextEpoch();
+    }
+    return root->_epoch & EPOCH_MASK;
+  }
+
+  bool Property::IsShared(const std::shared_ptr<Property>& property, uint32_t epoch)
+  {
+    return (property->_epoch & (FROZEN | SHARED)) || ((property->_epoch & EPOCH_MASK) != epoch && property.use_count() > 1);
+  }
+
+  std::shared_ptr<Property> Property::Privatize(const std::shared_ptr<Property>& property, uint32_t epoch)
+  {
+    auto copy = Clone(property);
+    copy->_epoch |= epoch;
+    return copy;
+  }
+
+  std::shared_ptr<Property> Property::Edit(const std::shared_ptr<Property>& root, const std::string& path)
+  {
+    if (root->_epoch & (FROZEN | SHARED))
+    {
+      throw std::runtime_error("edit failed");
+    }
+    const auto current = GetEpoch(root);
+
+    auto node = root;
+    size_t begin = 0;
+    while (begin < path.length())
+    {
+      auto end = path.find('/', begin);
+      if (end == std::string::npos) end = path.length();
+      const auto key = path.substr(begin, end - begin);
+      begin = end + 1;
+      if (key.empty()) continue;
+
+      std::shared_ptr<Property>* slot = nullptr;
+      if (std::holds_alternative<object_t>(node->_value))
+      {
+        auto& items = std::get<object_t>(node->_value);
+        const auto iter = items.find(key);
+        if (iter != items.end()) slot = &iter->second;
+      }
+      else if (std::holds_alternative<array_t>(node->_value))
+      {
+        auto& items = std::get<array_t>(node->_value);
+        char* tail = nullptr;
+        const auto index = std::strtoul(key.c_str(), &tail, 10);
+        if (*tail == '\0' && index < items.size()) slot = &items[index];
+      }
+
+      if (slot == nullptr || !*slot)
+      {
+        throw std::runtime_error("edit failed");
+      }
+
+      // a node referenced only by its (already private) parent needs no copy
+      if (IsShared(*slot, current))
+      {
+        *slot = Privatize(*slot, current);
+      }
+      (*slot)->_epoch = ((*slot)->_epoch & ~EPOCH_MASK) | current;
+
+      node = *slot;
+    }
+
+    return node;
+  }
+
+  namespace
+  {
+    uint64_t MixHash(uint64_t hash, uint64_t value)
+    {
+      hash ^= value + 0x9e3779b97f4a7c15ull;
+      hash *= 0xff51afd7ed558ccdull;
+      hash ^= hash >> 33;
+      hash *= 0xc4ceb9fe1a85ec53ull;
+      hash ^= hash >> 29;
+      return hash;
+    }
+
+    uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+    {
+      const auto bytes = reinterpret_cast<const uint8_t*>(data);
+
+      auto hash = MixHash(seed, size);
+      size_t i = 0;
+      for (; i + 8 <= size; i += 8)
+      {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + i, 8);
+        hash = MixHash(hash, word);
+      }
+      if (i < size)
+      {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + i, size - i);
+        hash = MixHash(hash, word);
+      }
+      return hash;
+    }
+
+    std::string JoinPath(const std::string& path, const std::string& key)
+    {
+      return path.empty() ? key : path + '/' + key;
+    }
+  }
+
+  std::atomic<uint64_t> Property::revision{ 1 };
+  std::atomic<uint64_t> Property::hashed{ 0 };
+
+  uint64_t Property::GetHash() const
+  {
+    // concurrent readers hash shared nodes at once, so those are never cached
+    const auto cache = !(_epoch & CONCURRENT);
+
+    if (std::holds_alternative<raw_t>(_value))
+    {
+      const auto& raw = std::get<raw_t>(_value);
+      const auto generation = raw.GetGeneration();
+      const auto cached = _hash.load(std::memory_order_acquire);
+      if (cached != 0 && _hash_stamp.load(std::memory_order_relaxed) == generation)
+      {
+        return cached;
+      }
+
+      const auto [bytes, size] = raw.GetBytes(0);
+      const auto hash = std::max(HashBytes(bytes, size, TYPE_RAW), uint64_t(1));
+      if (!cache) return hash;
+      _hash_stamp.store(generation, std::memory_order_relaxed);
+      _hash.store(hash, std::memory_order_release);
+      return hash;
+    }
+
+    if (std::holds_alternative<object_t>(_value) || std::holds_alternative<array_t>(_value))
+    {
+      const auto current = revision.load(std::memory_order_relaxed);
+      const auto cached = _hash.load(std::memory_order_acquire);
+      if (cached != 0 && _hash_stamp.load(std::memory_order_relaxed) == uint32_t(current))
+      {
+        return cached;
+      }
+
+      // from here on the next write moves the revision
+      auto latest = hashed.load(std::memory_order_relaxed);
+      while (cache && latest < current && !hashed.compare_exchange_weak(latest, current, std::memory_order_relaxed)) {}
+
+      uint64_t hash = 0;
+      if (std::holds_alternative<object_t>(_value))
+      {
+        hash = MixHash(TYPE_OBJECT, std::get<object_t>(_value).size());
+        for (const auto& [key, item] : std::get<object_t>(_value))
+        {
+          hash = MixHash(hash, HashBytes(key.data(), key.length(), 0));
+          hash = MixHash(hash, item ? item->GetHash() : 0);
+        }
+      }
+      else
+      {
+        hash = MixHash(TYPE_ARRAY, std::get<array_t>(_value).size());
+        for (const auto& item : std::get<array_t>(_value))
+        {
+          hash = MixHash(hash, item ? item->GetHash() : 0);
+        }
+      }
+      hash = std::max(hash, uint64_t(1));
+      if (!cache) return hash;
+
+      _hash_stamp.store(uint32_t(current), std::memory_order_relaxed);
+      _hash.store(hash, std::memory_order_release);
+      return hash;
+    }
+
+    if (std::holds_alternative<bool_t>(_value)) return MixHash(TYPE_BOOL, GetBool());
+    if (std::holds_alternative<sint_t>(_value)) return MixHash(TYPE_SINT, ToBits(GetSint()));
+    if (std::holds_alternative<uint_t>(_value)) return MixHash(TYPE_UINT, GetUint());
+    if (std::holds_alternative<real_t>(_value)) return MixHash(TYPE_REAL, ToBits(GetReal()));
+    if (std::holds_alternative<string_t>(_value))
+    {
+      const auto& value = std::get<string_t>(_value);
+      return HashBytes(value.data(), value.length(), TYPE_STRING);
+    }
+    return MixHash(TYPE_UNDEFINED, 0);
+  }
+
+  namespace
+  {
+    void DiffNodes(const std::shared_ptr<Property>& prev, const std::shared_ptr<Property>& next, const std::string& path, Property::patch_t& patch)
+    {
+      if (prev == next)
+      {
+        return;
+      }
+
+      if (!prev || !next || prev->GetType() != next->GetType())
+      {
+        patch.push_back({ Property::OPERATION_SET, path, next, 0 });
+        return;
+      }
+
+      if (prev->GetHash() == next->GetHash())
+      {
+        return;
+      }
+
+      switch (next->GetType())
+      {
+      case Property::TYPE_OBJECT:
+      {
+        const auto& prev_items = prev->GetObjectItems();
+        const auto& next_items = next->GetObjectItems();
+        for (const auto& [key, item] : prev_items)
+        {
+          if (next_items.find(key) == next_items.end())
+          {
+            patch.push_back({ Property::OPERATION_REMOVE, JoinPath(path, key), nullptr, 0 });
+          }
+        }
+        for (const auto& [key, item] : next_items)
+        {
+          const auto iter = prev_items.find(key);
+          DiffNodes(iter == prev_items.end() ? nullptr : iter->second, item, JoinPath(path, key), patch);
+        }
+        break;
+      }
+      case Property::TYPE_ARRAY:
+      {
+        const auto prev_size = prev->GetArraySize();
+        const auto next_size = next->GetArraySize();
+        if (prev_size != next_size)
+        {
+          patch.push_back({ Property::OPERATION_RESIZE, path, nullptr, next_size });
+        }
+        for (uint32_t i = 0; i < next_size; ++i)
+        {
+          DiffNodes(i < prev_size ? prev->GetArrayItem(i) : nullptr, next->GetArrayItem(i), JoinPath(path, std::to_string(i)), patch);
+        }
+        break;
+      }
+      case Property::TYPE_RAW:
+      {
+        const auto [prev_bytes, prev_size] = prev->GetRawBytes(0);
+        const auto [next_bytes, next_size] = next->GetRawBytes(0);
+        if (prev_size != next_size)
+        {
+          patch.push_back({ Property::OPERATION_SET, path, next, 0 });
+          break;
+        }
+
+        // differing 64-byte blocks, merged when closer than a block
+        const uint32_t block = 64;
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;
+        uint32_t total = 0;
+        for (uint32_t offset = 0; offset < next_size; offset += block)
+        {
+          const auto size = std::min(block, next_size - offset);
+          if (std::memcmp(reinterpret_cast<const uint8_t*>(prev_bytes) + offset, reinterpret_cast<const uint8_t*>(next_bytes) + offset, size) == 0) continue;
+          if (!ranges.empty() && ranges.back().second + block >= offset) ranges.back().second = offset + size;
+          else ranges.push_back({ offset, offset + size });
+          total += size;
+        }
+
+        if (total * 2 > next_size)
+        {
+          patch.push_back({ Property::OPERATION_SET, path, next, 0 });
+          break;
+        }
+
+        for (const auto& [begin, end] : ranges)
+        {
+          auto bytes = std::shared_ptr<Property>(new Property(Property::TYPE_RAW));
+          bytes->RawAllocate(end - begin);
+          bytes->SetRawBytes({ reinterpret_cast<const uint8_t*>(next_bytes) + begin, end - begin }, 0);
+          patch.push_back({ Property::OPERATION_BYTES, path, bytes, begin });
+        }
+        break;
+      }
+      default:
+      {
+        patch.push_back({ Property::OPERATION_SET, path, next, 0 });
+        break;
+      }
+      }
+    }
+  }
+
+  Property::patch_t Property::Diff(const std::shared_ptr<Property>& prev, const std::shared_ptr<Property>& next)
+  {
+    patch_t patch;
+    DiffNodes(prev, next, std::string(), patch);
+    return patch;
+  }
+
+  std::shared_ptr<Property> Property::Apply(const std::shared_ptr<Property>& root, const patch_t& patch)
+  {
+    auto result = root;
+
+    for (const auto& change : patch)
+    {
+      if (change.operation == OPERATION_SET && change.path.empty())
+      {
+        result = change.value;
+        continue;
+      }
+
+      switch (change.operation)
+      {
+      case OPERATION_RESIZE:
+      {
+        Edit(result, change.path)->SetArraySize(change.size);
+        break;
+      }
+      case OPERATION_BYTES:
+      {
+        const auto [bytes, size] = change.value->GetRawBytes(0);
+        Edit(result, change.path)->SetRawBytes({ bytes, size }, change.size);
+        break;
+      }
+      case OPERATION_SET:
+      case OPERATION_REMOVE:
+      {
+        const auto split = change.path.rfind('/');
+        const auto parent = Edit(result, split == std::string::npos ? std::string() : change.path.substr(0, split));
+        const auto key = split == std::string::npos ? change.path : change.path.substr(split + 1);
+
+        if (parent->GetType() == TYPE_OBJECT)
+        {
+          if (change.operation == OPERATION_SET) parent->SetObjectItem(key, change.value);
+          else parent->RemoveObjectItem(key);
+        }
+        else if (parent->GetType() == TYPE_ARRAY && change.operation == OPERATION_SET)
+        {
+          const auto index = uint32_t(std::stoul(key));
+          if (index >= parent->GetArraySize()) parent->SetArraySize(index + 1);
+          parent->SetArrayItem(index, change.value);
+        }
+        else
+        {
+          throw std::runtime_error("apply failed");
+        }
+        break;
+      }
+      }
+    }
+
+    return result;
+  }
+
+  namespace
+  {
+    std::atomic<int64_t> live_nodes[Property::TYPE_RAW + 1];
+    std::atomic<int64_t> live_string_bytes{ 0 };
+
+    // strings short enough for the small string buffer keep their characters
+    // inside the object and own no heap memory, whatever the buffer size
+    size_t GetHeapBytes(const std::string& value)
+    {
+      const auto data = reinterpret_cast<uintptr_t>(value.data());
+      const auto object = reinterpret_cast<uintptr_t>(&value);
+      return data >= object && data < object + sizeof(value) ? 0 : value.capacity() + 1;
+    }
+  }
+
+  void Property::Count(int32_t sign) const
+  {
+    live_nodes[GetType()].fetch_add(sign, std::memory_order_relaxed);
+    if (std::holds_alternative<string_t>(_value))
+    {
+      live_string_bytes.fetch_add(sign * int64_t(GetHeapBytes(std::get<string_t>(_value))), std::memory_order_relaxed);
+    }
+  }
+
+  void Property::Measure(Memory& memory) const
+  {
+    memory.nodes[GetType()] += 1;
+    memory.node_bytes += sizeof(Property);
+    memory.control_bytes += CONTROL_BLOCK_SIZE;
+
+    if (std::holds_alternative<string_t>(_value))
+    {
+      memory.string_bytes += GetHeapBytes(std::get<string_t>(_value));
+    }
+    else if (std::holds_alternative<object_t>(_value))
+    {
+      for (const auto& [key, item] : std::get<object_t>(_value))
+      {
+        memory.container_bytes += 4 * sizeof(void*) + sizeof(object_t::value_type);
+        memory.string_bytes += GetHeapBytes(key);
+      }
+    }
+    else if (std::holds_alternative<array_t>(_value))
+    {
+      memory.container_bytes += std::get<array_t>(_value).capacity() * sizeof(array_t::value_type);
+    }
+    else if (std::holds_alternative<raw_t>(_value))
+    {
+      memory.raw_bytes += std::get<raw_t>(_value).GetSize();
+    }
+  }
+
+  size_t Property::GetFootprint() const
+  {
+    Memory memory;
+    Measure(memory);
+    return size_t(memory.GetTotal());
+  }
+
+  Property::Memory Property::GetMemory()
+  {
+    Memory memory;
+    for (uint32_t i = 0; i <= TYPE_RAW; ++i)
+    {
+      memory.nodes[i] = uint64_t(std::max(int64_t(0), live_nodes[i].load(std::memory_order_relaxed)));
+    }
+    memory.node_bytes = memory.GetNodes() * sizeof(Property);
+    memory.control_bytes = memory.GetNodes() * CONTROL_BLOCK_SIZE;
+    memory.string_bytes = uint64_t(std::max(int64_t(0), live_string_bytes.load(std::memory_order_relaxed)));
+    memory.raw_bytes = Raw::GetResidency().resident_bytes;
+    return memory;
+  }
+
+  Property::Memory Property::GetMemory(const std::shared_ptr<Property>& root)
+  {
+    Memory memory;
+    std::unordered_set<const Property*> visited;
+    std::vector<const Property*> stack{ root.get() };
+    while (!stack.empty())
+    {
+      const auto node = stack.back();
+      stack.pop_back();
+      if (!node || !visited.insert(node).second) continue;
+
+      node->Measure(memory);
+      if (std::holds_alternative<object_t>(node->_value))
+      {
+        for (const auto& [key, item] : std::get<object_t>(node->_value)) stack.push_back(item.get());
+      }
+      else if (std::holds_alternative<array_t>(node->_value))
+      {
+        for (const auto& item : std::get<array_t>(node->_value)) stack.push_back(item.get());
+      }
+    }
+    return memory;
+  }
+
+  std::vector<Property::MemoryEntry> Property::GetMemoryTop(const std::shared_ptr<Property>& root, uint32_t n)
+  {
+    std::unordered_map<std::string, MemoryEntry> entries;
+    std::unordered_set<const Property*> visited;
+
+    // returns the subtree bytes not already attributed to an earlier path
+    std::function<uint64_t(const Property*, const std::string&)> walk_fn = [&entries, &visited, &walk_fn](const Property* node, const std::string& path)
+    {
+      if (!node || !visited.insert(node).second) return uint64_t(0);
+
+      Memory memory;
+      node->Measure(memory);
+      auto bytes = memory.GetTotal();
+      const auto self_bytes = bytes;
+
+      if (std::holds_alternative<object_t>(node->_value))
+      {
+        for (const auto& [key, item] : std::get<object_t>(node->_value)) bytes += walk_fn(item.get(), path.empty() ? key : path + '/' + key);
+      }
+      else if (std::holds_alternative<array_t>(node->_value))
+      {
+        const auto items_path = path.empty() ? std::string("*") : path + "/*";
+        for (const auto& item : std::get<array_t>(node->_value)) bytes += walk_fn(item.get(), items_path);
+      }
+
+      auto& entry = entries[path];
+      entry.nodes += 1;
+      entry.self_bytes += self_bytes;
+      entry.bytes += bytes;
+      return bytes;
+    };
+    walk_fn(root.get(), std::string());
+
+    std::vector<MemoryEntry> top;
+    top.reserve(entries.size());
+    for (auto& [path, entry] : entries)
+    {
+      entry.path = path;
+      top.push_back(std::move(entry));
+    }
+
+    const auto count = std::min(size_t(n), top.size());
+    std::partial_sort(top.begin(), top.begin() + count, top.end(), [](const auto& a, const auto& b) { return a.bytes > b.bytes; });
+    top.resize(count);
+    return top;
+  }
+
+  bool Interner::Equal(const std::shared_ptr<Property>& a, const std::shared_ptr<Property>& b)
+  {
+    const auto type = a->GetType();
+    if (type != b->GetType())
+    {
+      return false;
+    }
+
+    switch (type)
+    {
+    case Property::TYPE_UNDEFINED: return true;
+    case Property::TYPE_BOOL: return a->GetBool() == b->GetBool();
+    case Property::TYPE_SINT: return a->GetSint() == b->GetSint();
+    case Property::TYPE_UINT: return a->GetUint() == b->GetUint();
+    case Property::TYPE_REAL:
+    {
+      const auto a_value = a->GetReal();
+      const auto b_value = b->GetReal();
+      return std::memcmp(&a_value, &b_value, sizeof(a_value)) == 0;
+    }
+    case Property::TYPE_STRING: return a->GetString() == b->GetString();
+    case Property::TYPE_OBJECT:
+    {
+      // items are already canonical, so equal subtrees are the same node
+      const auto& a_items = a->GetObjectItems();
+      const auto& b_items = b->GetObjectItems();
+      return a_items.size() == b_items.size() && std::equal(a_items.begin(), a_items.end(), b_items.begin());
+    }
+    case Property::TYPE_ARRAY:
+    {
+      if (a->GetArraySize() != b->GetArraySize()) return false;
+      for (uint32_t i = 0; i < a->GetArraySize(); ++i)
+      {
+        if (a->GetArrayItem(i) != b->GetArrayItem(i)) return false;
+      }
+      return true;
+    }
+    case Property::TYPE_RAW:
+    {
+      if (a->GetRawLayout() != b->GetRawLayout() || a->GetRawSize() != b->GetRawSize()) return false;
+      const auto [a_bytes, a_size] = a->GetRawBytes(0);
+      const auto [b_bytes, b_size] = b->GetRawBytes(0);
+      return std::memcmp(a_bytes, b_bytes, a_size) == 0;
+    }
+    }
+
+    return false;
+  }
+
+  std::shared_ptr<Property> Interner::Intern(const std::shared_ptr<Property>& property)
+  {
+    if (!property)
+    {
+      return property;
+    }
+
+    if (!property->IsFrozen())
+    {
+      const auto type = property->GetType();
+      if (type == Property::TYPE_OBJECT)
+      {
+        for (const auto& [key, item] : property->GetObjectItems())
+        {
+          const auto canonical = Intern(item);
+          if (canonical != item) property->SetObjectItem(key, canonical);
+        }
+      }
+      else if (type == Property::TYPE_ARRAY)
+      {
+        for (uint32_t i = 0; i < property->GetArraySize(); ++i)
+        {
+          const auto& item = property->GetArrayItem(i);
+          const auto canonical = Intern(item);
+          if (canonical != item) property->SetArrayItem(i, canonical);
+        }
+      }
+    }
+
+    const auto hash = property->GetHash();
+    const auto range = table.equal_range(hash);
+    for (auto iter = range.first; iter != range.second; ++iter)
+    {
+      if (iter->second == property)
+      {
+        return property;
+      }
+      if (Equal(iter->second, property))
+      {
+        saved_bytes += property->GetFootprint();
+        saved_nodes += 1;
+        return iter->second;
+      }
+    }
+
+    property->Freeze();
+    table.emplace(hash, property);
+    return property;
+  }
+
   std::shared_ptr<Property> ParseJSON(const nlohmann::json& node)
   {
     std::shared_ptr<Property> property;
@@ -1847,7 +2893,7 @@ namespace RayGene3D
   //}
 
 
-  std::shared_ptr<Property> CreateInstanceProperty(std::vector<Instance>& scene_instances)
+  std::shared_ptr<Property> CreateInstanceProperty(std::vector<Instance>& scene_instances, Interner* interner)
   {
     const auto root_property = std::shared_ptr<Property>(new Property(Property::TYPE_ARRAY));
     //root_property->SetValue(Property::array());
@@ -1882,7 +2928,7 @@ namespace RayGene3D
       const auto debug_color_property = CreateFVec3Property();   debug_color_property->FromFVec3(instance.debug_color);   item_property->SetObjectItem("debug_color", debug_color_property);
       const auto geometry_idx_property = CreateUIntProperty();   geometry_idx_property->FromUInt(instance.geometry_idx);  item_property->SetObjectItem("geometry_idx", geometry_idx_property);
 
-      root_property->SetArrayItem(i, item_property);
+      root_property->SetArrayItem(i, interner ? interner->Intern(item_property) : item_property);
     }
 
     return root_property;
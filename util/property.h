@@ -29,10 +29,15 @@ THE SOFTWARE.
 
 #pragma once
 #include "types.h"
+#include "trace.h"
 
 #include <nlohmann/json.hpp>
 #include <digestpp/digestpp.hpp>
 
+#include <unordered_map>
+#include <set>
+#include <cstring>
+
 
 
 namespace RayGene3D
@@ -64,6 +69,8 @@ namespace RayGene3D
 
   class Property //Entity
   {
+    friend class ConcurrentTree;
+
   //protected:
   //  std::string name;
 
@@ -106,36 +113,119 @@ namespace RayGene3D
 
   protected:
     value_t _value;
+    // cached structural hash, 0 for none, valid while its stamp matches (see
+    // GetHash); concurrent scalars keep the bits of their value here instead
+    mutable std::atomic<uint64_t> _hash{ 0 };
+    mutable std::atomic<uint32_t> _hash_stamp{ 0 };
+    // epoch of the tree the node is private to, 0 for none, and the flags on top
+    uint32_t _epoch{ 0 };
+
+  protected:
+    static const uint32_t FROZEN = 0x80000000;      // shared canonical nodes must not change
+    static const uint32_t CONCURRENT = 0x40000000;  // reachable from a ConcurrentTree, see Get*
+    static const uint32_t SHARED = 0x20000000;      // reachable from a snapshot, see Snapshot
+    static const uint32_t EPOCH_MASK = 0x1fffffff;
+
+  protected:
+    void Touch()
+    {
+      if (_epoch & (FROZEN | SHARED)) throw std::runtime_error((_epoch & FROZEN) ? "property is frozen" : "property is shared");
+      if (!(_epoch & CONCURRENT)) _hash.store(0, std::memory_order_relaxed);
+      // container hashes cached since the last move of the revision are stale from now on
+      auto current = revision.load(std::memory_order_relaxed);
+      if (hashed.load(std::memory_order_relaxed) >= current) revision.compare_exchange_strong(current, current + 1, std::memory_order_relaxed);
+    }
+
+  protected:
+    // keeps the global per-type counters, called with -1 before and +1 after a type change
+    void Count(int32_t sign) const;
+    template<typename T>
+    void Assign(const T& value)
+    {
+      if (std::holds_alternative<T>(_value) && !std::is_same<T, string_t>::value) { _value = value; return; }
+      Count(-1);
+      _value = value;
+      Count(1);
+    }
+
+  protected:
+    template<typename T>
+    static uint32_t ToBits(T value) { uint32_t bits = 0; std::memcpy(&bits, &value, sizeof(T)); return bits; }
+    template<typename T>
+    static T FromBits(uint32_t bits) { T value; std::memcpy(&value, &bits, sizeof(T)); return value; }
+    template<typename T>
+    void Publish(T value) { if (_epoch & CONCURRENT) _hash.store(ToBits(value), std::memory_order_release); }
+    template<typename T>
+    T Read() const { return (_epoch & CONCURRENT) ? FromBits<T>(uint32_t(_hash.load(std::memory_order_acquire))) : std::get<T>(_value); }
+
+  protected:
+    static std::atomic<uint32_t> epoch;
+    static std::atomic<uint64_t> revision;
+    static std::atomic<uint64_t> hashed;  // latest revision a container hash was cached at
+    static uint32_t NextEpoch() { return ((epoch.fetch_add(1, std::memory_order_relaxed) + 1) & EPOCH_MASK) | 1; }
+    static void Share(const std::shared_ptr<Property>& property);
+
+  public:
+    Type GetType() const;
 
   public:
-    void SetBool(bool_t value) { _value = value; }
-    bool_t GetBool() const { return std::get<bool_t>(_value); }
-    void SetSint(sint_t value) { _value = value; }
-    sint_t GetSint() const { return std::get<sint_t>(_value); }
-    void SetUint(uint_t value) { _value = value; }
-    uint_t GetUint() const { return std::get<uint_t>(_value); }
-    void SetReal(real_t value) { _value = value; }
-    real_t GetReal() const { return std::get<real_t>(_value); }
-
-    void SetString(const string_t& value) { _value = value; }
+    void SetBool(bool_t value) { Touch(); Assign(value); Publish(value); }
+    bool_t GetBool() const { return Read<bool_t>(); }
+    void SetSint(sint_t value) { Touch(); Assign(value); Publish(value); }
+    sint_t GetSint() const { return Read<sint_t>(); }
+    void SetUint(uint_t value) { Touch(); Assign(value); Publish(value); }
+    uint_t GetUint() const { return Read<uint_t>(); }
+    void SetReal(real_t value) { Touch(); Assign(value); Publish(value); }
+    real_t GetReal() const { return Read<real_t>(); }
+
+    // Scalar access for concurrent readers (see ConcurrentTree). Nodes of a
+    // concurrent tree publish their scalar value atomically, so Get* and Load*
+    // on them read it without touching the variant and can race with Store*,
+    // which keeps the node's type. Other nodes are read as usual.
+    void StoreBool(bool_t value) { Touch(); std::get<bool_t>(_value) = value; Publish(value); }
+    bool_t LoadBool() const { return Read<bool_t>(); }
+    void StoreSint(sint_t value) { Touch(); std::get<sint_t>(_value) = value; Publish(value); }
+    sint_t LoadSint() const { return Read<sint_t>(); }
+    void StoreUint(uint_t value) { Touch(); std::get<uint_t>(_value) = value; Publish(value); }
+    uint_t LoadUint() const { return Read<uint_t>(); }
+    void StoreReal(real_t value) { Touch(); std::get<real_t>(_value) = value; Publish(value); }
+    real_t LoadReal() const { return Read<real_t>(); }
+
+    void SetString(const string_t& value) { Touch(); Assign(value); }
     const string_t& GetString() const { return std::get<string_t>(_value); }
 
+    const object_t& GetObjectItems() const { return std::get<object_t>(_value); }
     const std::shared_ptr<Property>& GetObjectItem(const std::string& name) const { return std::get<object_t>(_value).at(name); }
-    void SetObjectItem(const std::string& name, const std::shared_ptr<Property>& property) { std::get<object_t>(_value)[name] = property; }
+    void SetObjectItem(const std::string& name, const std::shared_ptr<Property>& property) { Touch(); std::get<object_t>(_value)[name] = property; }
     bool HasObjectItem(const std::string& name) { return std::get<object_t>(_value).find(name) != std::get<object_t>(_value).end(); }
-    void RemoveObjectItem(const std::string& name) { std::get<object_t>(_value).erase(name); }
+    void RemoveObjectItem(const std::string& name) { Touch(); std::get<object_t>(_value).erase(name); }
     //void VisitObjectItem(std::function<void(const std::string&, const std::shared_ptr<Property>&)> visitor) { for (auto& v : std::get<object>(_value)) visitor(v.first, v.second); }
     //uint32_t CountObjectItem(){ return static_cast<uint32_t>(std::get<object>(_value).size()); }
 
     const std::shared_ptr<Property>& GetArrayItem(uint32_t index) const { return std::get<array_t>(_value).at(index); }
-    void SetArrayItem(uint32_t index, const std::shared_ptr<Property>& property) { std::get<array_t>(_value).at(index) = property; }
+    void SetArrayItem(uint32_t index, const std::shared_ptr<Property>& property) { Touch(); std::get<array_t>(_value).at(index) = property; }
     uint32_t GetArraySize() const { return uint32_t(std::get<array_t>(_value).size()); }
-    void SetArraySize(uint32_t size) { std::get<array_t>(_value).resize(size); }
-
-    void RawAllocate(uint32_t size) { std::get<raw_t>(_value).Allocate(size); }
-    void RawFree() { std::get<raw_t>(_value).Free(); }
-    void SetRawBytes(std::pair<const void*, uint32_t> bytes, uint32_t offset) { std::get<raw_t>(_value).SetBytes(bytes, offset); }
+    void SetArraySize(uint32_t size) { Touch(); std::get<array_t>(_value).resize(size); }
+
+    void RawAllocate(uint32_t size) { Touch(); std::get<raw_t>(_value).Allocate(size); }
+    void RawFree() { Touch(); std::get<raw_t>(_value).Free(); }
+    uint32_t GetRawSize() const { return std::get<raw_t>(_value).GetSize(); }
+    void SetRawLayout(Raw::Layout layout) { Touch(); std::get<raw_t>(_value).SetLayout(layout); }
+    Raw::Layout GetRawLayout() const { return std::get<raw_t>(_value).GetLayout(); }
+    void SetRawBytes(std::pair<const void*, uint32_t> bytes, uint32_t offset) { Touch(); std::get<raw_t>(_value).SetBytes(bytes, offset); }
     std::pair<const void*, uint32_t> GetRawBytes(uint32_t offset) const { return std::get<raw_t>(_value).GetBytes(offset); }
+    std::pair<const void*, uint32_t> GetRawBytes(uint32_t offset, uint32_t size) const { return std::get<raw_t>(_value).GetBytes(offset, size); }
+    void SetRawSource(const std::shared_ptr<Raw::Source>& source) { Touch(); std::get<raw_t>(_value).Attach(source); }
+    void SetRawBacking(const Raw::backing_t& backing) { std::get<raw_t>(_value).SetBacking(backing); }
+    bool SetRawBacking(const Raw::backing_t& backing, uint32_t generation, const std::string& origin = std::string()) { return std::get<raw_t>(_value).SetBacking(backing, generation, origin); }
+    std::string GetRawOrigin() const { return std::get<raw_t>(_value).GetOrigin(); }
+    void SetRawPolicy(const Raw::Policy& policy) { std::get<raw_t>(_value).SetPolicy(policy); }
+    bool IsRawMapped() const { return std::get<raw_t>(_value).IsMapped(); }
+    bool IsRawResident() const { return std::get<raw_t>(_value).IsResident(); }
+    bool EvictRaw() { return std::get<raw_t>(_value).Evict(); }
+    const std::vector<std::pair<uint32_t, uint32_t>>& GetRawDirty() const { return std::get<raw_t>(_value).GetDirty(); }
+    uint32_t GetRawGeneration() const { return std::get<raw_t>(_value).GetGeneration(); }
+    void ClearRawDirty() { std::get<raw_t>(_value).ClearDirty(); }
     template<typename T> void SetTypedBytes(std::pair<const T*, uint32_t> bytes, uint32_t offset)
     {
       SetRawBytes({ bytes.first, uint32_t(bytes.second * sizeof(T)) }, uint32_t(offset * sizeof(T)));
@@ -144,6 +234,10 @@ namespace RayGene3D
     {
       const auto bytes = GetRawBytes(uint32_t(offset * sizeof(T))); return { reinterpret_cast<const T*>(bytes.first), uint32_t(bytes.second / sizeof(T)) };
     }
+    template<typename T> std::pair<const T*, uint32_t> GetTypedBytes(uint32_t offset, uint32_t count)
+    {
+      const auto bytes = GetRawBytes(uint32_t(offset * sizeof(T)), uint32_t(count * sizeof(T))); return { reinterpret_cast<const T*>(bytes.first), count };
+    }
 
 
 
@@ -183,12 +277,163 @@ namespace RayGene3D
       case TYPE_ARRAY:      _value.emplace<7>(); break;
       case TYPE_RAW:        _value.emplace<8>(); break;
       }
+      Count(1);
     }
-    ~Property() {}
+    ~Property() { Count(-1); }
+
+  public:
+    struct Summary
+    {
+      uint32_t updated{ 0 };  // scalars and raws changed in place
+      uint32_t added{ 0 };    // subtrees created where the structure differs
+      uint32_t removed{ 0 };  // subtrees dropped where the structure differs
+      uint32_t reused{ 0 };   // raws refilled in their existing allocation
+      std::vector<std::shared_ptr<Property>> changes;
+    };
+
+  protected:
+    static std::string EncodeHash(const raw_t& raw);
+    static nlohmann::json ToJSONNode(const std::shared_ptr<Property>& property, std::map<std::shared_ptr<Property>, std::string>& binaries, uint32_t inline_limit);
+    static std::shared_ptr<Property> FromJSONNode(const nlohmann::json& node, std::map<std::shared_ptr<Property>, std::string>& binaries);
+    static std::shared_ptr<Property> ReconcileNode(const nlohmann::json& node, const std::shared_ptr<Property>& property, uint32_t epoch, bool shared,
+      const std::set<std::string>& touched, std::map<std::shared_ptr<Property>, std::string>& binaries, Summary& summary);
 
   public:
-    static nlohmann::json ToJSON(const std::shared_ptr<Property>& property, std::map<std::shared_ptr<Property>, std::string>& binaries);
+    // the 48 character encoded content hash that names a sidecar
+    static bool IsHash(const std::string& value);
+
+  public:
+    static bool IsInline(const std::string& value);
+    static std::string EncodeInline(const raw_t& raw);
+    static bool DecodeInline(const std::string& value, const std::shared_ptr<Property>& property);
+
+  public:
+    static nlohmann::json ToJSON(const std::shared_ptr<Property>& property, std::map<std::shared_ptr<Property>, std::string>& binaries, uint32_t inline_limit = 0);
     static std::shared_ptr<Property> FromJSON(const nlohmann::json& node, std::map<std::shared_ptr<Property>, std::string>& binaries);
+    // updates the tree in place where it can, nodes shared with a snapshot are copied first;
+    // raws are compared by the sidecar backing them when they have one, and the
+    // touched hashes are read again even when the document still names them
+    static std::shared_ptr<Property> Reconcile(const nlohmann::json& node, const std::shared_ptr<Property>& property, std::map<std::shared_ptr<Property>, std::string>& binaries, Summary& summary,
+      const std::set<std::string>& touched = {});
+
+  public:
+    // A snapshot is a shallow copy of the root that shares every subtree with
+    // the live tree. Afterwards the live tree has to be mutated through Edit,
+    // which copies the nodes on a '/'-separated path (object keys or array
+    // indices) that are still shared, raws included. The setters of a shared
+    // node throw; Snapshot marks the nodes written since the previous one.
+    static std::shared_ptr<Property> Clone(const std::shared_ptr<Property>& property);
+    static std::shared_ptr<Property> Snapshot(const std::shared_ptr<Property>& root);
+    static std::shared_ptr<Property> Edit(const std::shared_ptr<Property>& root, const std::string& path);
+
+  public:
+    // Every root has its own epoch, a node stamped with it is private to that
+    // root. Writers outside of Edit check each node with IsShared and write a
+    // Privatize copy in its place when it is, as Edit does.
+    static uint32_t GetEpoch(const std::shared_ptr<Property>& root);
+    static bool IsShared(const std::shared_ptr<Property>& property, uint32_t epoch);
+    static std::shared_ptr<Property> Privatize(const std::shared_ptr<Property>& property, uint32_t epoch);
+
+  public:
+    // Raws cache their hash against their write generation and containers
+    // against a process-wide revision, which the first write to any node
+    // after a container hash was cached moves on. A write anywhere below a
+    // container is noticed that way, at the cost of rehashing unrelated
+    // trees once after it. Scalars and strings are hashed on every call.
+    uint64_t GetHash() const;
+
+  public:
+    // frozen nodes are never written; Edit copies them like shared nodes
+    void Freeze() { _epoch |= FROZEN; }
+    bool IsFrozen() const { return (_epoch & FROZEN) != 0; }
+    // shallow estimate of the heap bytes owned by this node alone
+    size_t GetFootprint() const;
+
+  public:
+    struct Memory
+    {
+      uint64_t nodes[TYPE_RAW + 1]{};  // live nodes per Type
+      uint64_t node_bytes{ 0 };        // the nodes themselves
+      uint64_t control_bytes{ 0 };     // shared_ptr control blocks, assuming one per node
+      uint64_t container_bytes{ 0 };   // map nodes and array storage
+      uint64_t string_bytes{ 0 };      // heap storage of strings and object keys
+      uint64_t raw_bytes{ 0 };
+
+      uint64_t GetNodes() const { uint64_t count = 0; for (const auto value : nodes) count += value; return count; }
+      uint64_t GetTotal() const { return node_bytes + control_bytes + container_bytes + string_bytes + raw_bytes; }
+    };
+
+    struct MemoryEntry
+    {
+      std::string path;          // array indices collapse to '*'
+      uint64_t nodes{ 0 };
+      uint64_t self_bytes{ 0 };  // the nodes on the path alone
+      uint64_t bytes{ 0 };       // including everything below them
+    };
+
+  protected:
+    static const size_t CONTROL_BLOCK_SIZE = 2 * sizeof(void*) + 2 * sizeof(uint32_t);
+    void Measure(Memory& memory) const;
+
+  public:
+    // Process-wide counters kept on node construction and destruction. They
+    // cover nodes, control blocks, string values and resident raws only, the
+    // container and key bytes are known per tree.
+    static Memory GetMemory();
+    // subtree estimate, nodes shared within the subtree are counted once
+    static Memory GetMemory(const std::shared_ptr<Property>& root);
+    // the n paths of the subtree holding the most bytes, largest first
+    static std::vector<MemoryEntry> GetMemoryTop(const std::shared_ptr<Property>& root, uint32_t n);
+
+  public:
+    enum Operation
+    {
+      OPERATION_SET = 0,
+      OPERATION_REMOVE = 1,
+      OPERATION_RESIZE = 2,
+      OPERATION_BYTES = 3,
+    };
+
+    struct Change
+    {
+      Operation operation{ OPERATION_SET };
+      std::string path;
+      std::shared_ptr<Property> value;  // set: new subtree (shared, not copied), bytes: raw with the new bytes
+      uint32_t size{ 0 };               // resize: array size, bytes: byte offset
+    };
+    typedef std::vector<Change> patch_t;
+
+  public:
+    // subtrees with equal hashes are skipped without being walked
+    static patch_t Diff(const std::shared_ptr<Property>& prev, const std::shared_ptr<Property>& next);
+    static std::shared_ptr<Property> Apply(const std::shared_ptr<Property>& root, const patch_t& patch);
+  };
+
+  // Hash-consing table: Intern canonicalises a subtree bottom-up and replaces
+  // every node with an already interned, structurally equal one. Interned
+  // nodes are frozen, so the canonical instances can be shared freely.
+  class Interner
+  {
+  protected:
+    std::unordered_multimap<uint64_t, std::shared_ptr<Property>> table;
+    size_t saved_bytes{ 0 };
+    uint32_t saved_nodes{ 0 };
+
+  protected:
+    static bool Equal(const std::shared_ptr<Property>& a, const std::shared_ptr<Property>& b);
+
+  public:
+    std::shared_ptr<Property> Intern(const std::shared_ptr<Property>& property);
+    void Clear() { table.clear(); saved_bytes = 0; saved_nodes = 0; }
+
+  public:
+    size_t GetSavedBytes() const { return saved_bytes; }
+    uint32_t GetSavedNodes() const { return saved_nodes; }
+    uint32_t GetUniqueNodes() const { return uint32_t(table.size()); }
+
+  public:
+    Interner() {}
+    ~Interner() {}
   };
 
   typedef std::shared_ptr<Property> SPtrProperty;
@@ -256,6 +501,8 @@ namespace RayGene3D
   std::shared_ptr<Property> CreateUIntProperty();
   std::shared_ptr<Property> CreateBufferProperty(const void* data, uint32_t stride, uint32_t count);
   std::shared_ptr<Property> CreateTextureProperty(const void* data, uint32_t stride, uint32_t size_x, uint32_t size_y, uint32_t mipmaps);
+  // with an interner, identical subtrees are shared as they are built
+  std::shared_ptr<Property> CreateInstanceProperty(std::vector<Instance>& scene_instances, Interner* interner = nullptr);
 
   //std::shared_ptr<Property> ImportOBJ(const std::string& path, const std::string& name, bool flip, float scale, uint32_t mipmaps);
   //std::shared_ptr<Property> ImportGLTF(const std::string& path, const std::string& name, bool flip, float scale, uint32_t mipmaps);
@@ -0,0 +1,169 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+#pragma once
+#include "types.h"
+
+namespace RayGene3D
+{
+  // Generational slot map: values live contiguously and are swapped with the
+  // last one on removal, while handles go through a slot table whose
+  // generation makes handles of removed values fail every lookup.
+  template<typename T>
+  class SlotMap
+  {
+  public:
+    struct Handle
+    {
+      uint32_t index{ UINT32_MAX };
+      uint32_t generation{ 0 };
+
+      bool operator==(const Handle& other) const { return index == other.index && generation == other.generation; }
+      bool operator!=(const Handle& other) const { return !(*this == other); }
+    };
+
+  protected:
+    struct Slot
+    {
+      uint32_t dense{ UINT32_MAX };  // value index while used, next free slot otherwise
+      uint32_t generation{ 0 };
+    };
+
+  protected:
+    std::vector<T> values;
+    std::vector<uint32_t> owners;
+    std::vector<Slot> slots;
+    uint32_t free_head{ UINT32_MAX };
+
+  protected:
+    void EraseAt(uint32_t dense)
+    {
+      const auto index = owners[dense];
+      const auto last = uint32_t(values.size() - 1);
+      if (dense != last)
+      {
+        values[dense] = std::move(values[last]);
+        owners[dense] = owners[last];
+        slots[owners[dense]].dense = dense;
+      }
+      values.pop_back();
+      owners.pop_back();
+
+      auto& slot = slots[index];
+      slot.generation += 1;
+      slot.dense = free_head;
+      free_head = index;
+    }
+
+  public:
+    Handle Insert(T value)
+    {
+      uint32_t index = free_head;
+      if (index != UINT32_MAX)
+      {
+        free_head = slots[index].dense;
+      }
+      else
+      {
+        index = uint32_t(slots.size());
+        slots.emplace_back();
+      }
+
+      auto& slot = slots[index];
+      slot.dense = uint32_t(values.size());
+      values.push_back(std::move(value));
+      owners.push_back(index);
+
+      return { index, slot.generation };
+    }
+
+    bool Erase(Handle handle)
+    {
+      if (!Contains(handle))
+      {
+        return false;
+      }
+
+      EraseAt(slots[handle.index].dense);
+      return true;
+    }
+
+    // compaction, O(1) per removed value
+    template<typename P>
+    uint32_t EraseIf(P&& predicate)
+    {
+      uint32_t erased = 0;
+      for (uint32_t dense = 0; dense < uint32_t(values.size());)
+      {
+        if (predicate(values[dense]))
+        {
+          EraseAt(dense);
+          erased += 1;
+        }
+        else
+        {
+          ++dense;
+        }
+      }
+      return erased;
+    }
+
+  public:
+    bool Contains(Handle handle) const
+    {
+      return handle.index < slots.size() && slots[handle.index].generation == handle.generation;
+    }
+
+    T* Find(Handle handle) { return Contains(handle) ? &values[slots[handle.index].dense] : nullptr; }
+    const T* Find(Handle handle) const { return Contains(handle) ? &values[slots[handle.index].dense] : nullptr; }
+
+    uint32_t GetSize() const { return uint32_t(values.size()); }
+    const std::vector<T>& GetValues() const { return values; }
+    // handle of the value at a position of GetValues
+    Handle GetHandle(uint32_t dense) const { return { owners[dense], slots[owners[dense]].generation }; }
+
+    template<typename F>
+    void Visit(F&& visitor) const
+    {
+      for (const auto& value : values) visitor(value);
+    }
+
+  public:
+    void Clear()
+    {
+      for (uint32_t dense = uint32_t(values.size()); dense > 0; --dense)
+      {
+        EraseAt(dense - 1);
+      }
+    }
+
+  public:
+    SlotMap() {}
+    ~SlotMap() {}
+  };
+}
@@ -0,0 +1,158 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "staging.h"
+
+namespace RayGene3D
+{
+  bool Staging::Reserve(uint32_t size, uint32_t& offset)
+  {
+    const auto capacity = uint32_t(arena.size());
+    const auto empty = commands.empty() && batches.empty();
+    if (empty)
+    {
+      head = 0;
+      tail = 0;
+    }
+
+    const auto aligned = (head + alignment - 1) / alignment * alignment;
+    if (empty || head > tail)
+    {
+      if (aligned <= capacity && size <= capacity - aligned)
+      {
+        offset = aligned;
+        head = aligned + size;
+        return true;
+      }
+
+      // wrap around, keeping one byte free so that head == tail stays unambiguous
+      if (!empty && size < tail)
+      {
+        offset = 0;
+        head = size;
+        return true;
+      }
+
+      return false;
+    }
+
+    if (head == tail)
+    {
+      return false;
+    }
+
+    if (aligned < tail && size < tail - aligned)
+    {
+      offset = aligned;
+      head = aligned + size;
+      return true;
+    }
+
+    return false;
+  }
+
+  bool Staging::Enqueue(const std::shared_ptr<Property>& property, uint32_t offset, std::pair<const void*, uint32_t> bytes)
+  {
+    if (bytes.second == 0)
+    {
+      return true;
+    }
+
+    if (offset > property->GetRawSize() || bytes.second > property->GetRawSize() - offset)
+    {
+      throw std::runtime_error("staging enqueue failed");
+    }
+
+    // a write continuing the previous one extends its command without padding
+    if (!commands.empty())
+    {
+      auto& last = commands.back();
+      const auto capacity = uint32_t(arena.size());
+      const auto limit = head < tail ? tail - 1 : capacity;
+      if (last.dst == property && last.dst_offset + last.size == offset
+        && last.src_offset + last.size == head && bytes.second <= limit - head)
+      {
+        std::memcpy(arena.data() + head, bytes.first, bytes.second);
+        head += bytes.second;
+        last.size += bytes.second;
+        return true;
+      }
+    }
+
+    uint32_t src_offset = 0;
+    if (!Reserve(bytes.second, src_offset))
+    {
+      return false;
+    }
+
+    std::memcpy(arena.data() + src_offset, bytes.first, bytes.second);
+    commands.push_back({ src_offset, property, offset, bytes.second });
+
+    return true;
+  }
+
+  uint32_t Staging::Apply()
+  {
+    uint32_t applied = 0;
+    for (const auto& command : commands)
+    {
+      command.dst->SetRawBytes({ arena.data() + command.src_offset, command.size }, command.dst_offset);
+      applied += command.size;
+    }
+
+    if (!commands.empty())
+    {
+      batches.push_back(head);
+      commands.clear();
+    }
+
+    return applied;
+  }
+
+  void Staging::Retire()
+  {
+    if (batches.empty())
+    {
+      return;
+    }
+
+    tail = batches.front();
+    batches.pop_front();
+  }
+
+  Staging::Staging(uint32_t capacity, uint32_t alignment)
+    : arena(capacity)
+    , alignment(alignment == 0 ? 1 : alignment)
+  {
+  }
+
+  Staging::~Staging()
+  {
+  }
+}
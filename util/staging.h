@@ -0,0 +1,86 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+#pragma once
+#include "property.h"
+
+#include <deque>
+
+namespace RayGene3D
+{
+  // Linearises many small property writes into one aligned ring arena. A
+  // batch is the set of writes between two Apply calls; its bytes stay in the
+  // arena until Retire, so a consumer can copy them from there in one go.
+  class Staging
+  {
+  public:
+    struct Command
+    {
+      uint32_t src_offset{ 0 };
+      std::shared_ptr<Property> dst;
+      uint32_t dst_offset{ 0 };
+      uint32_t size{ 0 };
+    };
+
+  protected:
+    std::vector<uint8_t> arena;
+    uint32_t alignment{ 16 };
+    uint32_t head{ 0 };
+    uint32_t tail{ 0 };
+
+  protected:
+    std::vector<Command> commands;
+    std::deque<uint32_t> batches;
+
+  protected:
+    bool Reserve(uint32_t size, uint32_t& offset);
+
+  public:
+    const std::vector<Command>& GetCommands() const { return commands; }
+    const uint8_t* GetArena() const { return arena.data(); }
+    uint32_t GetCapacity() const { return uint32_t(arena.size()); }
+    uint32_t GetInflight() const { return uint32_t(batches.size()); }
+
+  public:
+    // false when the arena has no room left until older batches retire
+    bool Enqueue(const std::shared_ptr<Property>& property, uint32_t offset, std::pair<const void*, uint32_t> bytes);
+    template<typename T>
+    bool EnqueueTyped(const std::shared_ptr<Property>& property, uint32_t offset, std::pair<const T*, uint32_t> items)
+    {
+      return Enqueue(property, uint32_t(offset * sizeof(T)), { items.first, uint32_t(items.second * sizeof(T)) });
+    }
+
+  public:
+    uint32_t Apply();
+    void Retire();
+
+  public:
+    Staging(uint32_t capacity, uint32_t alignment = 16);
+    virtual ~Staging();
+  };
+}
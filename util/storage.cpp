@@ -24,4 +24,298 @@ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
 LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 THE SOFTWARE.
-================================================================================*/
\ No newline at end of file
+================================================================================*/
+
+#include "storage.h"
+
+namespace RayGene3D
+{
+  std::vector<bool> Storage::Save(const batch_t& batch)
+  {
+    timings_t timings;
+    return Save(batch, timings);
+  }
+
+  std::vector<bool> Storage::Save(const batch_t& batch, timings_t& timings)
+  {
+    std::vector<bool> results(batch.size(), false);
+    timings.assign(batch.size(), std::chrono::microseconds(0));
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      results[i] = Save(batch[i].first, batch[i].second);
+      timings[i] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+    }
+    return results;
+  }
+
+  void Storage::Load(batch_t& batch) const
+  {
+    for (auto& [alias, property] : batch)
+    {
+      Load(alias, property);
+    }
+  }
+
+  Property::Summary Storage::Reload(const std::string& alias, std::shared_ptr<Property>& property) const
+  {
+    Property::Summary summary;
+
+    std::shared_ptr<Property> loaded;
+    Load(alias, loaded);
+    if (loaded)
+    {
+      summary.removed = property ? 1 : 0;
+      summary.added = 1;
+      summary.changes.push_back(loaded);
+      property = loaded;
+    }
+
+    return summary;
+  }
+
+  void Storage::StartScheduler()
+  {
+    if (!workers.empty())
+    {
+      return;
+    }
+
+    stopping = false;
+    workers.resize(worker_count);
+    for (auto& worker : workers)
+    {
+      worker = std::thread(&Storage::ProcessRequests, this);
+    }
+  }
+
+  void Storage::StopScheduler()
+  {
+    {
+      std::lock_guard<std::mutex> lock(scheduler_mutex);
+      stopping = true;
+    }
+    scheduler_condition.notify_all();
+
+    for (auto& worker : workers)
+    {
+      worker.join();
+    }
+    workers.clear();
+
+    std::lock_guard<std::mutex> lock(scheduler_mutex);
+    for (uint32_t i = 0; i < PRIORITY_COUNT; ++i)
+    {
+      metrics[i].cancelled += uint32_t(queues[i].size());
+      queues[i].clear();
+    }
+    requests.clear();
+    scheduler_condition.notify_all();
+  }
+
+  void Storage::ProcessRequests()
+  {
+    std::unique_lock<std::mutex> lock(scheduler_mutex);
+
+    for (;;)
+    {
+      uint32_t id = 0;
+      Request* request = nullptr;
+
+      // strict priority order; a request that does not fit the in-flight cap also holds back lower classes
+      const auto pick_fn = [this, &id, &request]()
+      {
+        request = nullptr;
+        for (uint32_t i = 0; i < PRIORITY_COUNT; ++i)
+        {
+          if (queues[i].empty()) continue;
+
+          auto& candidate = requests.at(queues[i].front());
+          if (candidate.measuring)
+          {
+            return true;
+          }
+          if (!candidate.measured || inflight_bytes == 0 || inflight_bytes + candidate.size <= inflight_limit)
+          {
+            id = queues[i].front();
+            request = &candidate;
+          }
+          return true;
+        }
+        return false;
+      };
+
+      scheduler_condition.wait(lock, [this, &pick_fn, &request]() { return stopping || (pick_fn() && request != nullptr); });
+      if (stopping)
+      {
+        return;
+      }
+
+      // measured here rather than on the enqueuing thread, the request keeps its place meanwhile
+      if (!request->measured)
+      {
+        request->measuring = true;
+        const auto alias = request->alias;
+        lock.unlock();
+
+        const auto size = Measure(alias);
+
+        lock.lock();
+        const auto iter = requests.find(id);
+        if (iter != requests.end())
+        {
+          iter->second.size = size;
+          iter->second.measured = true;
+          iter->second.measuring = false;
+        }
+        scheduler_condition.notify_all();
+        continue;
+      }
+
+      queues[request->priority].erase(request->position);
+      request->dispatched = true;
+      request->worker = std::this_thread::get_id();
+      inflight_bytes += request->size;
+
+      const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - request->queued);
+      auto& stats = metrics[request->priority];
+      stats.latency_total += latency;
+      stats.latency_max = std::max(stats.latency_max, latency);
+
+      const auto alias = request->alias;
+      lock.unlock();
+
+      std::shared_ptr<Property> property;
+      Load(alias, property);
+
+      lock.lock();
+      request = &requests.at(id);
+      inflight_bytes -= request->size;
+
+      if (request->cancelled)
+      {
+        metrics[request->priority].cancelled += 1;
+      }
+      else
+      {
+        metrics[request->priority].completed += 1;
+        metrics[request->priority].bytes += request->size;
+
+        const auto callback = request->callback;
+        lock.unlock();
+        if (callback) callback(property);
+        lock.lock();
+      }
+
+      requests.erase(id);
+      scheduler_condition.notify_all();
+    }
+  }
+
+  uint32_t Storage::Enqueue(const std::string& alias, Priority priority, callback_t callback, size_t size)
+  {
+    std::lock_guard<std::mutex> lock(scheduler_mutex);
+    StartScheduler();
+
+    const auto id = ++request_counter;
+    auto& request = requests[id];
+    request.alias = alias;
+    request.priority = priority;
+    request.size = size;
+    request.measured = size != 0;
+    request.callback = std::move(callback);
+    request.queued = std::chrono::steady_clock::now();
+    request.position = queues[priority].insert(queues[priority].end(), id);
+
+    metrics[priority].requested += 1;
+    scheduler_condition.notify_all();
+
+    return id;
+  }
+
+  bool Storage::Reprioritize(uint32_t id, Priority priority)
+  {
+    std::lock_guard<std::mutex> lock(scheduler_mutex);
+
+    const auto iter = requests.find(id);
+    if (iter == requests.end() || iter->second.dispatched)
+    {
+      return false;
+    }
+
+    auto& request = iter->second;
+    queues[priority].splice(queues[priority].end(), queues[request.priority], request.position);
+    request.priority = priority;
+    scheduler_condition.notify_all();
+
+    return true;
+  }
+
+  bool Storage::Cancel(uint32_t id)
+  {
+    std::lock_guard<std::mutex> lock(scheduler_mutex);
+
+    const auto iter = requests.find(id);
+    if (iter == requests.end() || iter->second.cancelled)
+    {
+      return false;
+    }
+
+    auto& request = iter->second;
+    if (request.dispatched)
+    {
+      // already being loaded, the result is dropped when the worker completes it
+      request.cancelled = true;
+      return true;
+    }
+
+    queues[request.priority].erase(request.position);
+    metrics[request.priority].cancelled += 1;
+    requests.erase(iter);
+    scheduler_condition.notify_all();
+
+    return true;
+  }
+
+  void Storage::Wait(uint32_t id)
+  {
+    std::unique_lock<std::mutex> lock(scheduler_mutex);
+
+    const auto iter = requests.find(id);
+    if (iter != requests.end() && iter->second.dispatched && iter->second.worker == std::this_thread::get_id())
+    {
+      throw std::runtime_error("wait failed");
+    }
+
+    scheduler_condition.wait(lock, [this, id]() { return requests.find(id) == requests.end(); });
+  }
+
+#ifdef RAYGENE3D_COROUTINES
+  Task<std::shared_ptr<Property>> Storage::LoadAsync(std::string alias, Priority priority, size_t size)
+  {
+    struct Awaiter
+    {
+      Storage& storage;
+      const std::string& alias;
+      Priority priority;
+      size_t size;
+      std::shared_ptr<Property> property;
+
+      bool await_ready() const noexcept { return false; }
+      void await_suspend(std::coroutine_handle<> awaiting)
+      {
+        // the callback may run before Enqueue returns, nothing is touched afterwards
+        storage.Enqueue(alias, priority, [this, awaiting](const std::shared_ptr<Property>& loaded)
+          {
+            property = loaded;
+            if (const auto system = JobSystem::GetCurrent()) system->Submit([awaiting]() { awaiting.resume(); });
+            else awaiting.resume();
+          }, size);
+      }
+      std::shared_ptr<Property> await_resume() { return std::move(property); }
+    };
+
+    co_return co_await Awaiter{ *this, alias, priority, size, nullptr };
+  }
+#endif
+}
\ No newline at end of file
@@ -27,14 +27,79 @@ THE SOFTWARE.
 ================================================================================*/
 #pragma once
 #include "property.h"
+#include "task.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 namespace RayGene3D
 {
   class Storage : public Usable //Serializable
   {
+  public:
+    typedef std::vector<std::pair<std::string, std::shared_ptr<Property>>> batch_t;
+    typedef std::function<void(const std::shared_ptr<Property>&)> callback_t;
+    typedef std::vector<std::chrono::microseconds> timings_t;
+
+  public:
+    enum Priority
+    {
+      PRIORITY_HIGH = 0,
+      PRIORITY_NORMAL = 1,
+      PRIORITY_LOW = 2,
+      PRIORITY_COUNT = 3,
+    };
+
+    struct Metrics
+    {
+      uint32_t requested{ 0 };
+      uint32_t completed{ 0 };
+      uint32_t cancelled{ 0 };
+      uint64_t bytes{ 0 };
+      std::chrono::microseconds latency_total{ 0 }; // time spent in the queue before dispatch
+      std::chrono::microseconds latency_max{ 0 };
+    };
+
+  protected:
+    struct Request
+    {
+      std::string alias;
+      Priority priority{ PRIORITY_NORMAL };
+      size_t size{ 0 };
+      callback_t callback;
+      std::chrono::steady_clock::time_point queued;
+      std::list<uint32_t>::iterator position;
+      bool measured{ false };
+      bool measuring{ false };
+      bool dispatched{ false };
+      bool cancelled{ false };
+      std::thread::id worker;
+    };
+
   protected:
     std::shared_ptr<Property> tree;
 
+  protected:
+    uint32_t inline_limit{ 0 };
+
+  protected:
+    std::map<uint32_t, Request> requests;
+    std::list<uint32_t> queues[PRIORITY_COUNT];
+    Metrics metrics[PRIORITY_COUNT];
+    uint32_t request_counter{ 0 };
+
+    size_t inflight_limit{ size_t(256) << 20 };
+    size_t inflight_bytes{ 0 };
+
+    uint32_t worker_count{ 2 };
+    std::vector<std::thread> workers;
+    bool stopping{ false };
+
+    mutable std::mutex scheduler_mutex;
+    std::condition_variable scheduler_condition;
+
   //protected:
   //  std::string alias;
 
@@ -55,11 +120,60 @@ namespace RayGene3D
   public:
     void SetTree(const std::shared_ptr<Property>& tree) { this->tree = tree; }
     const std::shared_ptr<Property>& GetTree() const { return tree; }
+
+  public:
+    // raws smaller than the limit are embedded in the document instead of a separate blob
+    void SetInlineLimit(uint32_t limit) { inline_limit = limit; }
+    uint32_t GetInlineLimit() const { return inline_limit; }
     
   public:
-    virtual void Save(const std::string& alias, const std::shared_ptr<Property>& property) = 0;
+    // false when the alias could not be written completely
+    virtual bool Save(const std::string& alias, const std::shared_ptr<Property>& property) = 0;
     virtual void Load(const std::string& alias, std::shared_ptr<Property>& property) const = 0;
 
+  public:
+    // success of every entry, in batch order
+    virtual std::vector<bool> Save(const batch_t& batch);
+    virtual void Load(batch_t& batch) const;
+    // reports the time spent on every entry, in batch order
+    virtual std::vector<bool> Save(const batch_t& batch, timings_t& timings);
+
+  public:
+    virtual Property::Summary Reload(const std::string& alias, std::shared_ptr<Property>& property) const;
+
+  public:
+    // bytes a load of the alias reads, called on a scheduler worker
+    virtual size_t Measure(const std::string&) const { return 0; }
+
+  protected:
+    void StartScheduler();
+    void StopScheduler();
+    void ProcessRequests();
+
+  public:
+    // Without a size the request is measured by the worker that picks it up.
+    // Callbacks run on a scheduler worker and must not wait for their own
+    // request, which throws; waiting for others holds the worker meanwhile.
+    uint32_t Enqueue(const std::string& alias, Priority priority, callback_t callback, size_t size = 0);
+    bool Reprioritize(uint32_t id, Priority priority);
+    bool Cancel(uint32_t id);
+    void Wait(uint32_t id);
+
+#ifdef RAYGENE3D_COROUTINES
+  public:
+    // Suspends the awaiting coroutine until the scheduler loaded the alias, it
+    // resumes on the current job system if there is one. Requests dropped by
+    // stopping the scheduler never resume, so await them before Discard.
+    Task<std::shared_ptr<Property>> LoadAsync(std::string alias, Priority priority = PRIORITY_NORMAL, size_t size = 0);
+#endif
+
+  public:
+    void SetInflightLimit(size_t limit) { std::lock_guard<std::mutex> lock(scheduler_mutex); inflight_limit = limit; }
+    size_t GetInflightLimit() const { std::lock_guard<std::mutex> lock(scheduler_mutex); return inflight_limit; }
+    void SetWorkerCount(uint32_t count) { worker_count = std::max(1u, count); }
+    uint32_t GetWorkerCount() const { return worker_count; }
+    Metrics GetMetrics(Priority priority) const { std::lock_guard<std::mutex> lock(scheduler_mutex); return metrics[priority]; }
+
   public:
     void Initialize() override = 0;
     void Use() override = 0;
@@ -74,6 +188,7 @@ namespace RayGene3D
 
     virtual ~Storage()
     {
+      StopScheduler();
       //property.reset();
     };
   };
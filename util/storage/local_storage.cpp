@@ -28,49 +28,398 @@ THE SOFTWARE.
 
 #include "local_storage.h"
 
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <filesystem>
+#include <random>
+#include <set>
+#include <sstream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace RayGene3D
 {
-  void LocalStorage::Save(const std::string& alias, const std::shared_ptr<Property>& property)
+  namespace
   {
-    std::map<std::shared_ptr<Property>, std::string> binaries;
-    auto json = Property::ToJSON(property, binaries);
+    bool ReadFile(const std::string& file_name, std::vector<uint8_t>& data)
+    {
+      std::ifstream file_stream(file_name, std::ios::in | std::ios::binary);
+      if (!file_stream.is_open())
+      {
+        return false;
+      }
+
+      file_stream.seekg(0, std::ios::end);
+      const size_t size = file_stream.tellg();
+      file_stream.seekg(0, std::ios::beg);
+
+      data.resize(size);
+      file_stream.read(reinterpret_cast<char*>(data.data()), size);
+      file_stream.close();
+
+      return true;
+    }
+
+    // pages an evicted raw back in from the sidecar it was saved to or loaded from
+    class SidecarSource : public Raw::Source
+    {
+    protected:
+      std::string file_name;
+      uint32_t raw_size{ 0 };
+
+    protected:
+      std::shared_ptr<Raw::Source> chunks;
+      std::atomic<bool> complete{ false };
+      std::mutex mutex;
+
+    public:
+      uint32_t GetSize() const override { return raw_size; }
+
+      void Fetch(uint8_t* bytes, uint32_t offset, uint32_t size) override
+      {
+        if (complete) return;
+
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!chunks && !complete)
+        {
+          std::vector<uint8_t> data;
+          if (!ReadFile(file_name, data))
+          {
+            throw std::runtime_error("page in failed");
+          }
+
+          if (IsCompressedGeometry({ data.data(), uint32_t(data.size()) }))
+          {
+            std::vector<uint8_t> raw;
+            DecompressGeometry({ data.data(), uint32_t(data.size()) }, raw);
+            data.swap(raw);
+          }
+          else if (IsCompressedChunks({ data.data(), uint32_t(data.size()) }))
+          {
+            chunks = std::make_shared<ChunkSource>(std::move(data));
+          }
+
+          if (!chunks)
+          {
+            if (data.size() != raw_size)
+            {
+              throw std::runtime_error("page in failed");
+            }
+            std::memcpy(bytes, data.data(), raw_size);
+            complete = true;
+            return;
+          }
+        }
+        lock.unlock();
+
+        if (chunks)
+        {
+          chunks->Fetch(bytes, offset, size);
+        }
+      }
+
+    public:
+      SidecarSource(const std::string& file_name, uint32_t raw_size)
+        : file_name(file_name)
+        , raw_size(raw_size)
+      {
+      }
+      virtual ~SidecarSource() {}
+    };
+
+    Raw::backing_t MakeBacking(const std::string& file_name, uint32_t size)
+    {
+      return [file_name, size]() { return std::make_shared<SidecarSource>(file_name, size); };
+    }
+
+    // the content has to be on disk before the rename makes it visible
+    bool SyncFile(const std::string& file_name)
+    {
+#ifdef __linux__
+      const auto fd = open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0)
+      {
+        return false;
+      }
+      const auto synced = fdatasync(fd) == 0;
+      close(fd);
+      return synced;
+#else
+      return true;
+#endif
+    }
+  }
+
+  std::string LocalStorage::GetTempName(const std::string& file_name) const
+  {
+    // random per process, so processes sharing the folder never pick the same name
+    static const auto token = []()
+    {
+      std::random_device device;
+      std::ostringstream stream;
+      stream << std::hex << device() << device();
+      return stream.str();
+    }();
+
+    return file_name + ".tmp" + token + '.' + std::to_string(temp_counter++);
+  }
+
+  std::shared_mutex& LocalStorage::GetAliasLock(const std::string& alias) const
+  {
+    return alias_locks[std::hash<std::string>()(alias) % std::size(alias_locks)];
+  }
+
+  std::vector<std::shared_mutex*> LocalStorage::GetAliasLocks(const batch_t& batch) const
+  {
+    // sorted and unique stripes, so that batches always acquire in the same order
+    std::set<size_t> stripes;
+    for (const auto& [alias, property] : batch)
+    {
+      stripes.insert(std::hash<std::string>()(alias) % std::size(alias_locks));
+    }
+
+    std::vector<std::shared_mutex*> locks;
+    for (const auto stripe : stripes)
+    {
+      locks.push_back(&alias_locks[stripe]);
+    }
+    return locks;
+  }
+
+  bool LocalStorage::Publish(const std::string& temp_name, const std::string& file_name) const
+  {
+    RAYGENE3D_TRACE(scope, "file.publish");
+    std::error_code error;
+    if (!SyncFile(temp_name))
+    {
+      std::filesystem::remove(temp_name, error);
+      return false;
+    }
+
+    // the watcher drops the event of this rename instead of reloading what was just saved
+    const auto watched_name = std::filesystem::path(file_name).filename().string();
+    if (watch_active)
+    {
+      std::lock_guard<std::mutex> lock(watch_mutex);
+      watch_published[watched_name] += 1;
+    }
+
+    std::filesystem::rename(temp_name, file_name, error);
+    if (error)
+    {
+      std::filesystem::remove(temp_name, error);
+      if (watch_active)
+      {
+        std::lock_guard<std::mutex> lock(watch_mutex);
+        const auto iter = watch_published.find(watched_name);
+        if (iter != watch_published.end() && --iter->second == 0) watch_published.erase(iter);
+      }
+      return false;
+    }
+    return true;
+  }
+
+  bool LocalStorage::WriteDocument(const std::string& file_name, const nlohmann::json& json) const
+  {
+    const auto temp_name = GetTempName(file_name);
 
     try
     {
-      std::string file_name = folder + '/' + alias + std::string(".json");
-      std::ofstream file_stream(file_name, std::ios::out);
-      file_stream << std::setw(4) << json << std::endl;
+      std::string text;
+      {
+        RAYGENE3D_TRACE(scope, "json.format");
+        text = json.dump(4);
+        RAYGENE3D_TRACE_BYTES(scope, text.size());
+      }
+
+      RAYGENE3D_TRACE(scope, "file.write_document");
+      RAYGENE3D_TRACE_BYTES(scope, text.size() + 1);
+      std::ofstream file_stream(temp_name, std::ios::out);
+      file_stream << text << std::endl;
       file_stream.close();
+
+      // a short write, such as on a full disk, must not replace the previous document
+      if (file_stream.fail())
+      {
+        std::error_code error;
+        std::filesystem::remove(temp_name, error);
+        return false;
+      }
     }
     catch (std::exception e)
     {
-      return;
+      return false;
     }
 
+    return Publish(temp_name, file_name);
+  }
+
+  bool LocalStorage::ReadDocument(const std::string& file_name, nlohmann::json& json) const
+  {
+    try
+    {
+      std::string text;
+      {
+        RAYGENE3D_TRACE(scope, "file.read_document");
+        std::ifstream file_stream(file_name, std::ios::in);
+        text.assign(std::istreambuf_iterator<char>(file_stream), std::istreambuf_iterator<char>());
+        file_stream.close();
+        RAYGENE3D_TRACE_BYTES(scope, text.size());
+      }
 
+      RAYGENE3D_TRACE(scope, "json.parse");
+      RAYGENE3D_TRACE_BYTES(scope, text.size());
+      json = nlohmann::json::parse(text);
+    }
+    catch (std::exception e)
+    {
+      return false;
+    }
+
+    return true;
+  }
+
+  bool LocalStorage::WriteBinary(const std::string& file_name, const std::shared_ptr<Property>& property) const
+  {
+    const auto temp_name = GetTempName(file_name);
+
+    std::ofstream file_stream(temp_name, std::ios::out | std::ios::binary);
+
+    // a write racing with this one leaves the raw unbacked, see below
+    const auto generation = property->GetRawGeneration();
+    const auto [byte, size] = property->GetRawBytes(0);
+    const auto layout = property->GetRawLayout();
+    const auto stride = layout == Raw::LAYOUT_VERTEX ? uint32_t(sizeof(Vertex)) : layout == Raw::LAYOUT_TRIANGLE ? uint32_t(sizeof(Triangle)) : 0u;
+
+    std::vector<uint8_t> packed;
+    if (compression)
+    {
+      RAYGENE3D_TRACE(scope, "binary.compress");
+      RAYGENE3D_TRACE_BYTES(scope, size);
+      packed = stride != 0 && size % stride == 0
+        ? CompressGeometry({ byte, size }, layout, compression_chunk, position_bits, texcoord_bits)
+        : CompressChunks({ byte, size }, compression_chunk);
+    }
+
+    {
+      RAYGENE3D_TRACE(scope, "file.write_binary");
+      RAYGENE3D_TRACE_BYTES(scope, compression ? packed.size() : size);
+      if (compression) file_stream.write(reinterpret_cast<const char*>(packed.data()), packed.size());
+      else file_stream.write(reinterpret_cast<const char*>(byte), size);
+      file_stream.close();
+    }
+
+    if (file_stream.fail())
+    {
+      std::error_code error;
+      std::filesystem::remove(temp_name, error);
+      return false;
+    }
+
+    if (!Publish(temp_name, file_name))
+    {
+      return false;
+    }
+
+    // quantised geometry does not round-trip, so only lossless sidecars back the raw
+    const auto lossless = !compression || stride == 0 || size % stride != 0 || (position_bits == 0 && texcoord_bits == 0);
+    if (lossless)
+    {
+      property->SetRawBacking(MakeBacking(file_name, size), generation, file_name);
+    }
+    return true;
+  }
+
+  bool LocalStorage::ReadBinary(const std::string& file_name, const std::shared_ptr<Property>& property, bool* reused) const
+  {
+    std::vector<uint8_t> data;
+    {
+      RAYGENE3D_TRACE(scope, "file.read_binary");
+      if (!ReadFile(file_name, data))
+      {
+        return false;
+      }
+      RAYGENE3D_TRACE_BYTES(scope, data.size());
+    }
+    const auto size = data.size();
+
+    // an existing allocation of the same size is overwritten in place
+    const auto current = property->GetRawSize();
+
+    if (IsCompressedGeometry({ data.data(), uint32_t(size) }))
+    {
+      RAYGENE3D_TRACE(scope, "binary.decompress");
+      RAYGENE3D_TRACE_BYTES(scope, size);
+      std::vector<uint8_t> raw;
+      const auto layout = DecompressGeometry({ data.data(), uint32_t(size) }, raw);
+      data.swap(raw);
+      property->SetRawLayout(layout);
+    }
+    else if (IsCompressedChunks({ data.data(), uint32_t(size) }))
+    {
+      const auto source = std::make_shared<ChunkSource>(std::move(data));
+      if (reused) *reused = current == source->GetSize();
+      property->SetRawSource(source);
+      property->SetRawBacking(MakeBacking(file_name, source->GetSize()), property->GetRawGeneration(), file_name);
+      return true;
+    }
+
+    const auto in_place = current == uint32_t(data.size());
+    if (!in_place)
+    {
+      if (current != 0) property->RawFree();
+      property->RawAllocate(uint32_t(data.size()));
+    }
+    property->SetRawBytes({ data.data(), uint32_t(data.size()) }, 0);
+    property->SetRawBacking(MakeBacking(file_name, uint32_t(data.size())), property->GetRawGeneration(), file_name);
+
+    if (reused) *reused = in_place;
+    return true;
+  }
+
+  bool LocalStorage::Save(const std::string& alias, const std::shared_ptr<Property>& property)
+  {
+    const auto hold = Raw::Hold();
+
+    std::map<std::shared_ptr<Property>, std::string> binaries;
+    auto json = Property::ToJSON(property, binaries, inline_limit);
+
+    std::unique_lock<std::shared_mutex> lock(GetAliasLock(alias));
+
+    // the document is only replaced once every sidecar it refers to is in place
+    bool written = true;
     for (auto& [key, value] : binaries)
     {
       std::string file_name = folder + '/' + alias + value;
-      std::ofstream file_stream(file_name, std::ios::out | std::ios::binary);
+      written = WriteBinary(file_name, key) && written;
+    }
 
-      const auto [byte, size] = key->GetRawBytes(0);
-      file_stream.write(reinterpret_cast<const char*>(byte), size);
-      file_stream.close();
+    if (!written)
+    {
+      return false;
     }
+
+    std::string file_name = folder + '/' + alias + std::string(".json");
+    return WriteDocument(file_name, json);
   }
 
   void LocalStorage::Load(const std::string& alias, std::shared_ptr<Property>& property) const
   {
+    const auto hold = Raw::Hold();
+
     nlohmann::json json;
 
-    try
-    {
-      std::string file_name = folder + '/' + alias + std::string(".json");
-      std::ifstream file_stream(file_name, std::ios::in);
-      file_stream >> std::setw(4) >> json;
-      file_stream.close();
-    }
-    catch (std::exception e)
+    std::shared_lock<std::shared_mutex> lock(GetAliasLock(alias));
+
+    std::string file_name = folder + '/' + alias + std::string(".json");
+    if (!ReadDocument(file_name, json))
     {
       return;
     }
@@ -81,20 +430,516 @@ namespace RayGene3D
     for (auto& [key, value] : binaries)
     {
       std::string file_name = folder + '/' + alias + value;
-      std::ifstream file_stream(file_name, std::ios::in | std::ios::binary);
+      ReadBinary(file_name, key);
+    }
+  }
 
-      file_stream.seekg(0, std::ios::end);
-      const size_t size = file_stream.tellg();
-      file_stream.seekg(0, std::ios::beg);
+  Property::Summary LocalStorage::Reload(const std::string& alias, std::shared_ptr<Property>& property) const
+  {
+    return Reload(alias, property, {});
+  }
 
-      auto data = new char[size];
-      file_stream.read(data, size);
-      file_stream.close();
+  Property::Summary LocalStorage::Reload(const std::string& alias, std::shared_ptr<Property>& property, const std::set<std::string>& touched) const
+  {
+    const auto hold = Raw::Hold();
+
+    Property::Summary summary;
+
+    std::shared_lock<std::shared_mutex> lock(GetAliasLock(alias));
+
+    nlohmann::json json;
+    if (!ReadDocument(folder + '/' + alias + std::string(".json"), json))
+    {
+      return summary;
+    }
+
+    std::map<std::shared_ptr<Property>, std::string> binaries;
+    const auto replacement = Property::Reconcile(json, property, binaries, summary, touched);
+    if (replacement)
+    {
+      property = replacement;
+    }
+
+    for (auto& [key, value] : binaries)
+    {
+      bool reused = false;
+      if (ReadBinary(folder + '/' + alias + value, key, &reused) && reused) summary.reused += 1;
+    }
 
-      key->RawAllocate(uint32_t(size));
-      key->SetRawBytes({ data, uint32_t(size) }, 0);
+    return summary;
+  }
 
-      delete[] data;
+  std::vector<bool> LocalStorage::Save(const batch_t& batch)
+  {
+    timings_t timings;
+    return Save(batch, timings);
+  }
+
+  std::vector<bool> LocalStorage::Save(const batch_t& batch, timings_t& timings)
+  {
+    const auto hold = Raw::Hold();
+    std::vector<bool> results(batch.size(), false);
+    timings.assign(batch.size(), std::chrono::microseconds(0));
+
+    struct Document
+    {
+      nlohmann::json json;
+      std::map<std::shared_ptr<Property>, std::string> binaries;
+    };
+    std::vector<Document> documents(batch.size());
+
+    // JSON building and hashing of every alias runs on workers, files are written afterwards
+    JobSystem::For(uint32_t(batch.size()), [this, &batch, &documents, &timings](uint32_t i)
+      {
+        const auto start = std::chrono::steady_clock::now();
+        documents[i].json = Property::ToJSON(batch[i].second, documents[i].binaries, inline_limit);
+        timings[i] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+      });
+
+    std::vector<std::unique_lock<std::shared_mutex>> locks;
+    for (const auto& alias_lock : GetAliasLocks(batch))
+    {
+      locks.emplace_back(*alias_lock);
+    }
+
+    // blobs shared between aliases are written once and hard-linked for the others
+    struct Blob
+    {
+      size_t index;
+      std::shared_ptr<Property> key;
+      std::string file_name;
+    };
+    struct Link
+    {
+      std::shared_ptr<Property> key;
+      std::string file_name;
+      size_t blob;
+    };
+    std::vector<Blob> blobs;
+    std::vector<std::vector<Link>> links(batch.size());
+    {
+      std::map<std::string, size_t> planned;
+      for (size_t i = 0; i < batch.size(); ++i)
+      {
+        for (const auto& [key, value] : documents[i].binaries)
+        {
+          auto file_name = folder + '/' + batch[i].first + value;
+          const auto iter = planned.find(value);
+          if (iter != planned.end())
+          {
+            links[i].push_back({ key, std::move(file_name), iter->second });
+            continue;
+          }
+          planned.emplace(value, blobs.size());
+          blobs.push_back({ i, key, std::move(file_name) });
+        }
+      }
+    }
+
+    std::vector<uint8_t> blob_results(blobs.size(), 0);
+    std::vector<std::chrono::microseconds> blob_timings(blobs.size(), std::chrono::microseconds(0));
+    JobSystem::For(uint32_t(blobs.size()), [this, &blobs, &blob_results, &blob_timings](uint32_t i)
+      {
+        const auto start = std::chrono::steady_clock::now();
+        blob_results[i] = WriteBinary(blobs[i].file_name, blobs[i].key) ? 1 : 0;
+        blob_timings[i] = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+      });
+
+    std::vector<uint8_t> complete(batch.size(), 1);
+    for (size_t i = 0; i < blobs.size(); ++i)
+    {
+      timings[blobs[i].index] += blob_timings[i];
+      if (!blob_results[i]) complete[blobs[i].index] = 0;
+    }
+
+    // a copy whose blob failed, or which cannot be linked, is written on its own
+    JobSystem::For(uint32_t(batch.size()), [this, &batch, &documents, &timings, &blobs, &blob_results, &links, &complete](uint32_t i)
+      {
+        const auto start = std::chrono::steady_clock::now();
+
+        for (const auto& link : links[i])
+        {
+          if (blob_results[link.blob])
+          {
+            const auto temp_name = GetTempName(link.file_name);
+
+            std::error_code error;
+            std::filesystem::create_hard_link(blobs[link.blob].file_name, temp_name, error);
+            if (!error && Publish(temp_name, link.file_name)) continue;
+          }
+
+          if (!WriteBinary(link.file_name, link.key)) complete[i] = 0;
+        }
+
+        if (complete[i])
+        {
+          std::string file_name = folder + '/' + batch[i].first + std::string(".json");
+          complete[i] = WriteDocument(file_name, documents[i].json) ? 1 : 0;
+        }
+
+        timings[i] += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+      });
+
+    for (size_t i = 0; i < batch.size(); ++i) results[i] = complete[i] != 0;
+    return results;
+  }
+
+  void LocalStorage::Load(batch_t& batch) const
+  {
+    const auto hold = Raw::Hold();
+
+    struct Document
+    {
+      bool ready{ false };
+      std::shared_ptr<Property> property;
+      std::map<std::shared_ptr<Property>, std::string> binaries;
+    };
+    std::vector<Document> documents(batch.size());
+
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    for (const auto& alias_lock : GetAliasLocks(batch))
+    {
+      locks.emplace_back(*alias_lock);
+    }
+
+    std::mutex mutex;
+    std::condition_variable condition;
+
+    // workers read and parse JSON, the calling thread issues blob reads as soon as a document is ready
+    std::atomic<size_t> next{ 0 };
+    const auto parse_fn = [this, &batch, &documents, &next, &mutex, &condition]()
+    {
+      for (auto i = next++; i < batch.size(); i = next++)
+      {
+        std::shared_ptr<Property> property;
+        std::map<std::shared_ptr<Property>, std::string> binaries;
+
+        nlohmann::json json;
+        std::string file_name = folder + '/' + batch[i].first + std::string(".json");
+        if (ReadDocument(file_name, json))
+        {
+          property = Property::FromJSON(json, binaries);
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          documents[i].property = std::move(property);
+          documents[i].binaries = std::move(binaries);
+          documents[i].ready = true;
+        }
+        condition.notify_one();
+      }
+    };
+
+    // on the shared pool when one is running, otherwise on temporary threads
+    const auto system = JobSystem::GetCurrent();
+    std::unique_ptr<JobSystem::Group> group(system ? new JobSystem::Group(*system) : nullptr);
+    std::vector<std::thread> workers;
+    const auto parallelism = std::min(size_t(system ? system->GetWorkerCount() : std::max(1u, std::thread::hardware_concurrency())), batch.size());
+    for (size_t i = 0; i < parallelism; ++i)
+    {
+      if (group) group->Run(parse_fn);
+      else workers.emplace_back(parse_fn);
+    }
+
+    // blobs shared between aliases are read once and copied from the first loaded instance
+    struct Copy
+    {
+      size_t index{ 0 };
+      std::shared_ptr<Property> key;
+      std::string file_name;
+      std::shared_ptr<Property> source;
+      std::string source_name;
+    };
+    std::map<std::string, std::pair<std::shared_ptr<Property>, std::string>> loaded;
+    std::vector<Copy> copies;
+
+    // an alias with a blob that could not be read is loaded as null
+    std::vector<bool> failed(batch.size(), false);
+    std::set<std::shared_ptr<Property>> broken;
+
+    std::vector<bool> consumed(batch.size(), false);
+    // reserved up front, so collecting the ready documents under the lock never reallocates
+    std::vector<size_t> ready;
+    ready.reserve(batch.size());
+    for (size_t remaining = batch.size(); remaining > 0;)
+    {
+      const auto available = [&documents, &consumed]()
+      {
+        for (size_t i = 0; i < documents.size(); ++i) if (documents[i].ready && !consumed[i]) return true;
+        return false;
+      };
+
+      // a pool worker calling in must help parsing, as the pool may have no one else left
+      ready.clear();
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (group && !available())
+        {
+          lock.unlock();
+          if (group->IsDone()) group->Wait();
+          if (!system->RunOne(group.get())) std::this_thread::yield();
+          lock.lock();
+        }
+        condition.wait(lock, available);
+        for (size_t i = 0; i < documents.size(); ++i)
+        {
+          if (documents[i].ready && !consumed[i])
+          {
+            consumed[i] = true;
+            ready.push_back(i);
+          }
+        }
+      }
+      remaining -= ready.size();
+
+      std::vector<std::tuple<std::string, std::shared_ptr<Property>, size_t>> reads;
+      for (const auto i : ready)
+      {
+        if (!documents[i].property) continue;
+
+        for (const auto& [key, value] : documents[i].binaries)
+        {
+          const auto file_name = folder + '/' + batch[i].first + value;
+
+          // the first instance may be read in this same round, so copies wait for the reads
+          const auto iter = loaded.find(value);
+          if (iter != loaded.end())
+          {
+            copies.push_back({ i, key, file_name, iter->second.first, iter->second.second });
+            continue;
+          }
+
+          loaded.emplace(value, std::make_pair(key, file_name));
+          reads.push_back({ file_name, key, i });
+        }
+      }
+
+      std::sort(reads.begin(), reads.end(), [](const auto& a, const auto& b) { return std::get<0>(a) < std::get<0>(b); });
+      for (const auto& [file_name, key, i] : reads)
+      {
+        if (ReadBinary(file_name, key)) continue;
+        failed[i] = true;
+        broken.insert(key);
+      }
+
+      // copies share the backing of their source, a copy of a failed read reads its own blob instead
+      for (const auto& copy : copies)
+      {
+        if (broken.count(copy.source) != 0)
+        {
+          if (!ReadBinary(copy.file_name, copy.key)) failed[copy.index] = true;
+          continue;
+        }
+
+        const auto [bytes, size] = copy.source->GetRawBytes(0);
+        copy.key->SetRawLayout(copy.source->GetRawLayout());
+        if (size == 0) continue;
+        copy.key->RawAllocate(size);
+        copy.key->SetRawBytes({ bytes, size }, 0);
+        copy.key->SetRawBacking(MakeBacking(copy.source_name, size), copy.key->GetRawGeneration(), copy.source_name);
+      }
+      copies.clear();
+
+      for (const auto i : ready)
+      {
+        if (!documents[i].property || failed[i]) continue;
+        batch[i].second = documents[i].property;
+      }
+    }
+
+    if (group) group->Wait();
+    for (auto& worker : workers) worker.join();
+  }
+
+  size_t LocalStorage::Measure(const std::string& alias) const
+  {
+    const auto document_name = folder + '/' + alias + std::string(".json");
+
+    std::error_code error;
+    const auto file_size = std::filesystem::file_size(document_name, error);
+    if (error)
+    {
+      return 0;
+    }
+    size_t size = size_t(file_size);
+
+    std::string text;
+    {
+      std::ifstream file_stream(document_name, std::ios::in);
+      text.assign(std::istreambuf_iterator<char>(file_stream), std::istreambuf_iterator<char>());
+    }
+
+    // only the sidecars this document refers to, by their quoted 48 character encoded hash
+    const auto is_hash_fn = [&text](size_t offset)
+    {
+      for (size_t i = 0; i < 48; i += 3)
+      {
+        if (text[offset + i] != '-' || !std::isxdigit(text[offset + i + 1]) || !std::isxdigit(text[offset + i + 2])) return false;
+      }
+      return true;
+    };
+
+    std::set<std::string> sidecars;
+    for (auto begin = text.find("\"-"); begin != std::string::npos; begin = text.find("\"-", begin + 1))
+    {
+      if (begin + 49 < text.length() && text[begin + 49] == '"' && is_hash_fn(begin + 1))
+      {
+        sidecars.insert(text.substr(begin + 1, 48));
+      }
+    }
+
+    for (const auto& value : sidecars)
+    {
+      const auto sidecar_size = std::filesystem::file_size(folder + '/' + alias + value, error);
+      if (!error) size += size_t(sidecar_size);
+    }
+
+    return size;
+  }
+
+  void LocalStorage::WatchFolder()
+  {
+#ifdef __linux__
+    const auto watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd < 0)
+    {
+      return;
+    }
+
+    const auto watch_wd = inotify_add_watch(watch_fd, folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch_wd < 0)
+    {
+      close(watch_fd);
+      return;
+    }
+    watch_active = true;
+
+    alignas(inotify_event) char buffer[4096];
+    while (!watch_stopping)
+    {
+      pollfd poll_fd{ watch_fd, POLLIN, 0 };
+      if (poll(&poll_fd, 1, 100) <= 0)
+      {
+        continue;
+      }
+
+      for (auto length = read(watch_fd, buffer, sizeof(buffer)); length > 0; length = read(watch_fd, buffer, sizeof(buffer)))
+      {
+        std::lock_guard<std::mutex> lock(watch_mutex);
+        for (auto ptr = buffer; ptr < buffer + length;)
+        {
+          const auto event = reinterpret_cast<const inotify_event*>(ptr);
+          if (event->len > 0)
+          {
+            const auto name = std::string(event->name);
+            const auto iter = watch_published.find(name);
+            if (iter == watch_published.end()) watch_pending.insert(name);
+            else if (--iter->second == 0) watch_published.erase(iter);
+          }
+          ptr += sizeof(inotify_event) + event->len;
+        }
+      }
+    }
+
+    watch_active = false;
+    {
+      std::lock_guard<std::mutex> lock(watch_mutex);
+      watch_published.clear();
+    }
+
+    inotify_rm_watch(watch_fd, watch_wd);
+    close(watch_fd);
+#endif
+  }
+
+  void LocalStorage::StartWatcher()
+  {
+    if (watch_thread.joinable())
+    {
+      return;
+    }
+
+    watch_stopping = false;
+    watch_thread = std::thread(&LocalStorage::WatchFolder, this);
+  }
+
+  void LocalStorage::StopWatcher()
+  {
+    if (!watch_thread.joinable())
+    {
+      return;
+    }
+
+    watch_stopping = true;
+    watch_thread.join();
+  }
+
+  void LocalStorage::Watch(const std::string& alias, const std::shared_ptr<Property>& property, notify_t notify)
+  {
+    auto& entry = watched[alias];
+    entry.property = property;
+    entry.notify = std::move(notify);
+  }
+
+  void LocalStorage::Unwatch(const std::string& alias)
+  {
+    watched.erase(alias);
+  }
+
+  void LocalStorage::Refresh(const std::string& alias, const std::set<std::string>& touched)
+  {
+    const auto iter = watched.find(alias);
+    if (iter == watched.end())
+    {
+      return;
+    }
+    auto& entry = iter->second;
+
+    const auto changes = Reload(alias, entry.property, touched).changes;
+    if (!changes.empty() && entry.notify)
+    {
+      entry.notify(alias, changes);
+    }
+  }
+
+  void LocalStorage::Use()
+  {
+    std::set<std::string> pending;
+    {
+      std::lock_guard<std::mutex> lock(watch_mutex);
+      pending.swap(watch_pending);
+    }
+
+    if (pending.empty())
+    {
+      return;
+    }
+
+    std::vector<std::pair<std::string, std::set<std::string>>> refreshes;
+    for (const auto& [alias, entry] : watched)
+    {
+      const auto json_changed = pending.find(alias + std::string(".json")) != pending.end();
+
+      std::set<std::string> touched;
+      for (const auto& file_name : pending)
+      {
+        if (file_name.length() == alias.length() + 48 && file_name.compare(0, alias.length(), alias) == 0 && file_name[alias.length()] == '-')
+        {
+          touched.insert(file_name.substr(alias.length()));
+        }
+      }
+
+      if (json_changed || !touched.empty())
+      {
+        refreshes.emplace_back(alias, std::move(touched));
+      }
+    }
+
+    // notify callbacks may watch or unwatch aliases
+    for (const auto& [alias, touched] : refreshes)
+    {
+      Refresh(alias, touched);
     }
   }
 }
\ No newline at end of file
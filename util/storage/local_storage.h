@@ -27,21 +27,118 @@ THE SOFTWARE.
 ================================================================================*/
 
 #include "../storage.h"
+#include "../compression.h"
+#include "../job_system.h"
+
+#include <shared_mutex>
+#include <atomic>
 
 namespace RayGene3D
 {
+  // Save and Load may be called from any number of threads on one instance.
+  // Each alias is guarded by its own reader/writer lock: loads of an alias run
+  // concurrently with each other, a save of an alias excludes other saves and
+  // loads of that alias only. Files are written under a temporary name,
+  // flushed to disk and renamed into place, sidecars first and the JSON
+  // document last, and a document is not replaced when one of its sidecars
+  // failed, so other processes never observe a partially written alias.
+  //
+  //
+  // With compression enabled, sidecars are written as independently
+  // compressed chunks. Loading attaches them to the Raw undecoded and only
+  // the chunks covering the bytes actually requested get decompressed.
+  // Raws tagged with a vertex or triangle layout go through the geometry
+  // codec first and are decoded as a whole on load.
+  //
+  // With the watcher started (Linux, inotify), changes to the JSON or sidecar
+  // files of watched aliases are collected in the background and applied in
+  // Use() on the calling thread: only blobs whose hash changed or whose
+  // sidecar was rewritten are re-read, into the existing Raw allocation when
+  // the size matches, and the notify callback receives the nodes that were
+  // modified or replaced.
   class LocalStorage : public Storage
   {
+  public:
+    typedef std::function<void(const std::string&, const std::vector<std::shared_ptr<Property>>&)> notify_t;
+
   protected:
     std::string folder{ "cache" };
 
+  protected:
+    bool compression{ false };
+    uint32_t compression_chunk{ 1u << 18 };
+    uint32_t position_bits{ 0 };
+    uint32_t texcoord_bits{ 0 };
+
+  protected:
+    struct Watched
+    {
+      std::shared_ptr<Property> property;
+      notify_t notify;
+    };
+    std::map<std::string, Watched> watched;
+    std::set<std::string> watch_pending;
+    // names this instance is about to publish, whose events are its own
+    mutable std::map<std::string, uint32_t> watch_published;
+    mutable std::mutex watch_mutex;
+    std::thread watch_thread;
+    std::atomic<bool> watch_active{ false };
+    std::atomic<bool> watch_stopping{ false };
+
+  protected:
+    // striped by alias hash, aliases sharing a stripe also share their lock
+    mutable std::shared_mutex alias_locks[64];
+    mutable std::atomic<uint32_t> temp_counter{ 0 };
+
+  protected:
+    std::shared_mutex& GetAliasLock(const std::string& alias) const;
+    std::vector<std::shared_mutex*> GetAliasLocks(const batch_t& batch) const;
+
+  protected:
+    std::string GetTempName(const std::string& file_name) const;
+    bool Publish(const std::string& temp_name, const std::string& file_name) const;
+    bool WriteDocument(const std::string& file_name, const nlohmann::json& json) const;
+    bool ReadDocument(const std::string& file_name, nlohmann::json& json) const;
+    bool WriteBinary(const std::string& file_name, const std::shared_ptr<Property>& property) const;
+    // false when the sidecar cannot be read, the property is left untouched then
+    bool ReadBinary(const std::string& file_name, const std::shared_ptr<Property>& property, bool* reused = nullptr) const;
+
+  protected:
+    // touched sidecars are read again even when the document still names them
+    Property::Summary Reload(const std::string& alias, std::shared_ptr<Property>& property, const std::set<std::string>& touched) const;
+    void WatchFolder();
+
   public:
-    void Save(const std::string& alias, const std::shared_ptr<Property>& property) override;
+    bool Save(const std::string& alias, const std::shared_ptr<Property>& property) override;
     void Load(const std::string& alias, std::shared_ptr<Property>& property) const override;
 
+  public:
+    std::vector<bool> Save(const batch_t& batch) override;
+    std::vector<bool> Save(const batch_t& batch, timings_t& timings) override;
+    // blobs shared between aliases are read once, an alias with an unreadable blob stays null
+    void Load(batch_t& batch) const override;
+
+  public:
+    Property::Summary Reload(const std::string& alias, std::shared_ptr<Property>& property) const override;
+
+  public:
+    size_t Measure(const std::string& alias) const override;
+
+  public:
+    void SetCompression(bool enable, uint32_t chunk_size = 1u << 18) { compression = enable; compression_chunk = std::max(1u, chunk_size); }
+    bool GetCompression() const { return compression; }
+    void SetQuantization(uint32_t position_bits, uint32_t texcoord_bits) { this->position_bits = position_bits; this->texcoord_bits = texcoord_bits; }
+
+  public:
+    void StartWatcher();
+    void StopWatcher();
+    void Watch(const std::string& alias, const std::shared_ptr<Property>& property, notify_t notify);
+    void Unwatch(const std::string& alias);
+    void Refresh(const std::string& alias, const std::set<std::string>& touched = {});
+
   public:
     void Initialize() override {};
-    void Use() override {};
+    void Use() override;
     void Discard() override {};
 
   public:
@@ -49,6 +146,9 @@ namespace RayGene3D
       : Storage("local_storage")
     {}
     virtual ~LocalStorage()
-    {}
+    {
+      StopWatcher();
+      StopScheduler();
+    }
   };
 }
\ No newline at end of file
@@ -0,0 +1,268 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+#pragma once
+#include "job_system.h"
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#include <optional>
+#include <utility>
+
+#define RAYGENE3D_COROUTINES 1
+
+namespace RayGene3D
+{
+  template<typename T>
+  class Task;
+
+  template<typename T>
+  struct TaskPromiseBase
+  {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+
+    struct FinalAwaiter
+    {
+      bool await_ready() noexcept { return false; }
+      template<typename P>
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<P> handle) noexcept
+      {
+        const auto continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  template<typename T>
+  struct TaskPromise : TaskPromiseBase<T>
+  {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T result) { value.emplace(std::move(result)); }
+    T Take()
+    {
+      if (this->exception) std::rethrow_exception(this->exception);
+      return std::move(*value);
+    }
+  };
+
+  template<>
+  struct TaskPromise<void> : TaskPromiseBase<void>
+  {
+    Task<void> get_return_object();
+    void return_void() {}
+    void Take()
+    {
+      if (this->exception) std::rethrow_exception(this->exception);
+    }
+  };
+
+  // Lazily started coroutine producing one value. Awaiting a task starts it,
+  // the awaiter is resumed on whichever thread the task finishes on.
+  template<typename T>
+  class Task
+  {
+  public:
+    typedef TaskPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> handle_t;
+
+  protected:
+    handle_t handle;
+
+  protected:
+    template<typename U>
+    friend U SyncWait(Task<U> task);
+
+  public:
+    // an empty or moved-from task is ready and throws when resumed
+    struct Awaiter
+    {
+      handle_t handle;
+
+      bool await_ready() const noexcept { return !handle || handle.done(); }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+      {
+        handle.promise().continuation = awaiting;
+        return handle;
+      }
+      T await_resume()
+      {
+        if (!handle) throw std::runtime_error("task invalid");
+        return handle.promise().Take();
+      }
+    };
+
+    Awaiter operator co_await() const noexcept { return { handle }; }
+
+  public:
+    bool IsValid() const { return bool(handle); }
+    bool IsDone() const { return handle && handle.done(); }
+
+  public:
+    Task& operator=(Task&& other) noexcept
+    {
+      if (this != &other)
+      {
+        if (handle) handle.destroy();
+        handle = std::exchange(other.handle, nullptr);
+      }
+      return *this;
+    }
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+  public:
+    explicit Task(handle_t handle = nullptr) : handle(handle) {}
+    ~Task()
+    {
+      if (handle) handle.destroy();
+    }
+  };
+
+  template<typename T>
+  Task<T> TaskPromise<T>::get_return_object() { return Task<T>(Task<T>::handle_t::from_promise(*this)); }
+
+  inline Task<void> TaskPromise<void>::get_return_object() { return Task<void>(Task<void>::handle_t::from_promise(*this)); }
+
+  // Eagerly started coroutine nobody awaits, it frees itself when done.
+  struct Detached
+  {
+    struct promise_type
+    {
+      Detached get_return_object() { return {}; }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() {}
+      void unhandled_exception() { std::terminate(); }
+    };
+  };
+
+  // Moves the awaiting coroutine onto the current job system, e.g. to decode
+  // on the pool after a load resumed it on a storage thread.
+  struct Schedule
+  {
+    bool await_ready() const noexcept { return JobSystem::GetCurrent() == nullptr; }
+    void await_suspend(std::coroutine_handle<> awaiting) const
+    {
+      JobSystem::GetCurrent()->Submit([awaiting]() { awaiting.resume(); });
+    }
+    void await_resume() const noexcept {}
+  };
+
+  // Starts every task at once and resumes when all of them finished, results
+  // in task order. The first exception thrown is rethrown after all finished.
+  template<typename T>
+  Task<std::vector<T>> WhenAll(std::vector<Task<T>> tasks)
+  {
+    struct State
+    {
+      std::vector<std::optional<T>> results;
+      std::atomic<size_t> remaining{ 0 };
+      std::coroutine_handle<> continuation;
+      std::exception_ptr exception;
+      std::mutex mutex;
+    } state;
+    state.results.resize(tasks.size());
+
+    struct Awaiter
+    {
+      State& state;
+      std::vector<Task<T>>& tasks;
+
+      bool await_ready() const noexcept { return tasks.empty(); }
+      bool await_suspend(std::coroutine_handle<> awaiting)
+      {
+        state.continuation = awaiting;
+        state.remaining = tasks.size() + 1;
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+          [](State& state, const Task<T>& task, size_t i) -> Detached
+          {
+            try
+            {
+              state.results[i].emplace(co_await task);
+            }
+            catch (...)
+            {
+              std::lock_guard<std::mutex> lock(state.mutex);
+              if (!state.exception) state.exception = std::current_exception();
+            }
+            if (--state.remaining == 0) state.continuation.resume();
+          }(state, tasks[i], i);
+        }
+        // the extra count keeps the last task from resuming before this returns
+        return --state.remaining != 0;
+      }
+      void await_resume() const noexcept {}
+    };
+
+    co_await Awaiter{ state, tasks };
+    if (state.exception) std::rethrow_exception(state.exception);
+
+    std::vector<T> results;
+    results.reserve(tasks.size());
+    for (auto& result : state.results) results.push_back(std::move(*result));
+    co_return results;
+  }
+
+  // Blocks the calling thread until the task finished, for use outside coroutines.
+  template<typename T>
+  T SyncWait(Task<T> task)
+  {
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool done = false;
+
+    [](const Task<T>& task, std::mutex& mutex, std::condition_variable& condition, bool& done) -> Detached
+    {
+      try
+      {
+        co_await task;
+      }
+      catch (...)
+      {
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      done = true;
+      condition.notify_one();
+    }(task, mutex, condition, done);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&done]() { return done; });
+    return typename Task<T>::Awaiter{ task.handle }.await_resume();
+  }
+}
+#endif
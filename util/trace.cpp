@@ -0,0 +1,233 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+
+#include "trace.h"
+
+#include <nlohmann/json.hpp>
+
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <sstream>
+#include <cmath>
+
+namespace RayGene3D
+{
+  namespace
+  {
+    struct Event
+    {
+      const char* name;
+      std::chrono::steady_clock::time_point start;
+      std::chrono::nanoseconds duration;
+      uint64_t bytes;
+    };
+
+    // written by its own thread, read when reporting; outlives the thread
+    struct ThreadTrace
+    {
+      std::mutex mutex;
+      std::unordered_map<const char*, Trace::Histogram> histograms;
+      std::vector<Event> events;
+      uint32_t dropped{ 0 };
+      uint32_t id{ 0 };
+    };
+
+    struct Tracer
+    {
+      std::mutex mutex;
+      std::vector<std::shared_ptr<ThreadTrace>> threads;
+      std::atomic<bool> capture{ false };
+      std::atomic<uint32_t> limit{ 1u << 20 };
+      const std::chrono::steady_clock::time_point origin{ std::chrono::steady_clock::now() };
+    };
+
+    Tracer& GetTracer()
+    {
+      static Tracer tracer;
+      return tracer;
+    }
+
+    ThreadTrace& GetThreadTrace()
+    {
+      thread_local const auto local = []()
+      {
+        auto& tracer = GetTracer();
+        const auto thread = std::make_shared<ThreadTrace>();
+        std::lock_guard<std::mutex> lock(tracer.mutex);
+        thread->id = uint32_t(tracer.threads.size() + 1);
+        tracer.threads.push_back(thread);
+        return thread;
+      }();
+      return *local;
+    }
+  }
+
+  void Trace::Histogram::Add(std::chrono::nanoseconds duration, uint64_t bytes)
+  {
+    count += 1;
+    this->bytes += bytes;
+    total += duration;
+    max = std::max(max, duration);
+
+    auto bucket = 0u;
+    for (auto ns = uint64_t(duration.count()); ns > 1 && bucket + 1 < BUCKET_COUNT; ns >>= 1) bucket += 1;
+    buckets[bucket] += 1;
+  }
+
+  void Trace::Histogram::Merge(const Histogram& other)
+  {
+    count += other.count;
+    bytes += other.bytes;
+    total += other.total;
+    max = std::max(max, other.max);
+    for (uint32_t i = 0; i < BUCKET_COUNT; ++i) buckets[i] += other.buckets[i];
+  }
+
+  std::chrono::nanoseconds Trace::Histogram::GetPercentile(double fraction) const
+  {
+    const auto target = uint64_t(std::ceil(fraction * double(count)));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+      seen += buckets[i];
+      if (seen >= target && seen != 0) return std::min(max, std::chrono::nanoseconds(int64_t(2) << i));
+    }
+    return max;
+  }
+
+  Trace::Scope::~Scope()
+  {
+    Record(name, start, std::chrono::steady_clock::now(), bytes);
+  }
+
+  void Trace::Record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, uint64_t bytes)
+  {
+    auto& tracer = GetTracer();
+    auto& thread = GetThreadTrace();
+    const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+
+    std::lock_guard<std::mutex> lock(thread.mutex);
+    thread.histograms[name].Add(duration, bytes);
+    if (tracer.capture.load(std::memory_order_relaxed))
+    {
+      if (thread.events.size() < tracer.limit.load(std::memory_order_relaxed)) thread.events.push_back({ name, start, duration, bytes });
+      else thread.dropped += 1;
+    }
+  }
+
+  void Trace::SetCapture(bool capture, uint32_t limit)
+  {
+    auto& tracer = GetTracer();
+    tracer.limit = limit;
+    tracer.capture = capture;
+  }
+
+  std::map<std::string, Trace::Histogram> Trace::GetHistograms()
+  {
+    auto& tracer = GetTracer();
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+
+    std::map<std::string, Histogram> histograms;
+    for (const auto& thread : tracer.threads)
+    {
+      std::lock_guard<std::mutex> thread_lock(thread->mutex);
+      for (const auto& [name, histogram] : thread->histograms) histograms[name].Merge(histogram);
+    }
+    return histograms;
+  }
+
+  std::string Trace::GetSummary()
+  {
+    const auto us_fn = [](std::chrono::nanoseconds duration) { return double(duration.count()) * 1e-3; };
+
+    std::ostringstream stream;
+    stream << std::left << std::setw(24) << "operation" << std::right << std::setw(10) << "count" << std::setw(14) << "total ms"
+      << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::setw(12) << "max us" << std::setw(12) << "MiB" << '\n';
+    stream << std::fixed << std::setprecision(1);
+    for (const auto& [name, histogram] : GetHistograms())
+    {
+      stream << std::left << std::setw(24) << name << std::right << std::setw(10) << histogram.count << std::setw(14) << us_fn(histogram.total) * 1e-3
+        << std::setw(12) << us_fn(histogram.GetPercentile(0.5)) << std::setw(12) << us_fn(histogram.GetPercentile(0.99))
+        << std::setw(12) << us_fn(histogram.max) << std::setw(12) << double(histogram.bytes) / double(1 << 20) << '\n';
+    }
+    return stream.str();
+  }
+
+  bool Trace::WriteChrome(const std::string& file_name)
+  {
+    auto& tracer = GetTracer();
+
+    auto events = nlohmann::json::array();
+    uint32_t dropped = 0;
+    {
+      std::lock_guard<std::mutex> lock(tracer.mutex);
+      for (const auto& thread : tracer.threads)
+      {
+        std::lock_guard<std::mutex> thread_lock(thread->mutex);
+        for (const auto& event : thread->events)
+        {
+          nlohmann::json json;
+          json["name"] = event.name;
+          json["cat"] = "raygene3d";
+          json["ph"] = "X";
+          json["ts"] = double(std::chrono::duration_cast<std::chrono::nanoseconds>(event.start - tracer.origin).count()) * 1e-3;
+          json["dur"] = double(event.duration.count()) * 1e-3;
+          json["pid"] = 1;
+          json["tid"] = thread->id;
+          if (event.bytes != 0) json["args"]["bytes"] = event.bytes;
+          events.push_back(std::move(json));
+        }
+        dropped += thread->dropped;
+      }
+    }
+
+    nlohmann::json json;
+    json["traceEvents"] = std::move(events);
+    json["displayTimeUnit"] = "ns";
+    json["otherData"]["dropped"] = dropped;
+
+    std::ofstream file_stream(file_name, std::ios::out);
+    file_stream << json;
+    return bool(file_stream);
+  }
+
+  void Trace::Reset()
+  {
+    auto& tracer = GetTracer();
+    std::lock_guard<std::mutex> lock(tracer.mutex);
+    for (const auto& thread : tracer.threads)
+    {
+      std::lock_guard<std::mutex> thread_lock(thread->mutex);
+      thread->histograms.clear();
+      thread->events.clear();
+      thread->dropped = 0;
+    }
+  }
+}
@@ -0,0 +1,93 @@
+/*================================================================================
+RayGene3D Framework
+--------------------------------------------------------------------------------
+RayGene3D is licensed under MIT License
+================================================================================
+The MIT License
+--------------------------------------------------------------------------------
+Copyright (c) 2021
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+================================================================================*/
+
+#pragma once
+#include "types.h"
+
+#include <chrono>
+
+namespace RayGene3D
+{
+  // Latency histograms and byte counters per named operation, plus an
+  // optional event capture for chrome://tracing and Perfetto. Scopes are
+  // placed with the macros below, which compile to nothing unless
+  // RAYGENE3D_TRACING is defined. Names must be string literals.
+  class Trace
+  {
+  public:
+    static const uint32_t BUCKET_COUNT = 40;  // log2 of nanoseconds
+
+    struct Histogram
+    {
+      uint64_t count{ 0 };
+      uint64_t bytes{ 0 };
+      std::chrono::nanoseconds total{ 0 };
+      std::chrono::nanoseconds max{ 0 };
+      uint64_t buckets[BUCKET_COUNT]{};
+
+      void Add(std::chrono::nanoseconds duration, uint64_t bytes);
+      void Merge(const Histogram& other);
+      // upper bound of the bucket holding the given fraction of samples
+      std::chrono::nanoseconds GetPercentile(double fraction) const;
+    };
+
+    class Scope
+    {
+    protected:
+      const char* name{ nullptr };
+      std::chrono::steady_clock::time_point start;
+      uint64_t bytes{ 0 };
+
+    public:
+      void AddBytes(uint64_t count) { bytes += count; }
+
+    public:
+      Scope(const char* name, uint64_t bytes = 0) : name(name), start(std::chrono::steady_clock::now()), bytes(bytes) {}
+      ~Scope();
+    };
+
+  public:
+    static void Record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end, uint64_t bytes);
+
+  public:
+    // events are kept per thread up to the limit, histograms are always kept
+    static void SetCapture(bool capture, uint32_t limit = 1u << 20);
+    static std::map<std::string, Histogram> GetHistograms();
+    static std::string GetSummary();
+    static bool WriteChrome(const std::string& file_name);
+    static void Reset();
+  };
+}
+
+#ifdef RAYGENE3D_TRACING
+#define RAYGENE3D_TRACE(scope, name) RayGene3D::Trace::Scope scope(name)
+#define RAYGENE3D_TRACE_BYTES(scope, count) scope.AddBytes(uint64_t(count))
+#else
+#define RAYGENE3D_TRACE(scope, name)
+#define RAYGENE3D_TRACE_BYTES(scope, count)
+#endif
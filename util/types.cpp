@@ -27,16 +27,554 @@ THE SOFTWARE.
 ================================================================================*/
 
 
-//#pragma once
-//#include "object.h"
-
-//void Property::Initialize()
-//{
-//
-//}
-//
-//
-//void Property::Discard()
-//{
-//
-//}
\ No newline at end of file
+#include "types.h"
+
+#include <mutex>
+#include <unordered_set>
+#include <fstream>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifdef RAYGENE3D_LIBNUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
+
+namespace RayGene3D
+{
+  namespace
+  {
+    struct Registry
+    {
+      std::mutex mutex;
+      std::unordered_set<Raw*> raws;
+      uint64_t tickets{ 0 };
+
+      std::atomic<uint64_t> budget{ 0 };
+      std::atomic<uint64_t> resident_bytes{ 0 };
+      std::atomic<uint32_t> resident_count{ 0 };
+      std::atomic<uint32_t> evictions{ 0 };
+      std::atomic<uint64_t> evicted_bytes{ 0 };
+      std::atomic<uint32_t> reloads{ 0 };
+      std::atomic<uint64_t> reloaded_bytes{ 0 };
+
+      std::mutex reload_mutex;
+      std::shared_mutex hold;
+
+      // kept between frames so trimming does not allocate
+      std::vector<std::pair<uint32_t, Raw*>> candidates;
+
+      std::mutex policy_mutex;
+      Raw::Policy policy;
+      std::atomic<bool> policy_custom{ false };
+    };
+
+    Registry& GetRegistry()
+    {
+      static Registry registry;
+      return registry;
+    }
+
+#ifdef __linux__
+    const size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+    const size_t MASK_BITS = 8 * sizeof(unsigned long);
+
+#ifndef RAYGENE3D_LIBNUMA
+    // memory policy modes of mbind(2), <numaif.h> comes only with libnuma
+    const int MPOL_PREFERRED = 1;
+    const int MPOL_INTERLEAVE = 3;
+#endif
+
+    // online nodes as a bit mask, from a list such as "0-1,3"
+    const std::vector<unsigned long>& GetOnlineNodes()
+    {
+      static const auto nodes = []()
+      {
+        const auto list = []()
+        {
+          std::string line;
+          std::ifstream file("/sys/devices/system/node/online");
+          return (file >> line) ? line : std::string(1, '0');
+        }();
+
+        std::vector<unsigned long> mask(1, 0);
+        for (size_t begin = 0; begin < list.length();)
+        {
+          auto end = list.find(',', begin);
+          if (end == std::string::npos) end = list.length();
+          const auto range = list.substr(begin, end - begin);
+          begin = end + 1;
+
+          const auto dash = range.find('-');
+          const auto first = std::strtoul(range.c_str(), nullptr, 10);
+          const auto last = dash == std::string::npos ? first : std::strtoul(range.c_str() + dash + 1, nullptr, 10);
+          for (auto node = first; node <= last; ++node)
+          {
+            if (mask.size() <= node / MASK_BITS) mask.resize(node / MASK_BITS + 1, 0);
+            mask[node / MASK_BITS] |= 1ul << (node % MASK_BITS);
+          }
+        }
+        return mask;
+      }();
+      return nodes;
+    }
+
+    // best effort, a failed bind leaves the default first-touch placement
+    void Bind(void* data, size_t length, const Raw::Policy& policy)
+    {
+#ifdef RAYGENE3D_LIBNUMA
+      if (numa_available() < 0) return;
+      if (policy.interleave)
+      {
+        numa_interleave_memory(data, length, numa_all_nodes_ptr);
+        return;
+      }
+#endif
+      const int mode = policy.interleave ? MPOL_INTERLEAVE : MPOL_PREFERRED;
+
+      auto mask = GetOnlineNodes();
+      if (!policy.interleave)
+      {
+        const auto node = size_t(policy.node);
+        mask.assign(std::max(mask.size(), node / MASK_BITS + 1), 0);
+        mask[node / MASK_BITS] |= 1ul << (node % MASK_BITS);
+      }
+      syscall(SYS_mbind, data, length, mode, mask.data(), mask.size() * MASK_BITS + 1, 0);
+    }
+
+    // reserves an extra huge page to align the start, so transparent huge pages can back all of it
+    void* MapAligned(size_t length)
+    {
+      const auto reserved = length + HUGE_PAGE_SIZE;
+      const auto data = mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (data == MAP_FAILED)
+      {
+        return data;
+      }
+
+      const auto begin = reinterpret_cast<uintptr_t>(data);
+      const auto aligned = (begin + HUGE_PAGE_SIZE - 1) & ~uintptr_t(HUGE_PAGE_SIZE - 1);
+      if (aligned != begin) munmap(data, aligned - begin);
+      if (aligned + length != begin + reserved) munmap(reinterpret_cast<void*>(aligned + length), begin + reserved - aligned - length);
+      return reinterpret_cast<void*>(aligned);
+    }
+#endif
+  }
+
+  std::atomic<uint32_t> Raw::frame{ 0 };
+  const std::vector<std::pair<uint32_t, uint32_t>> Raw::clean;
+  std::vector<Raw::Victim> Raw::victims;
+
+  // only backed raws can be evicted, so only they are registered
+  void Raw::SetBacking(const backing_t& backing)
+  {
+    auto& state = GetState();
+
+    auto& registry = GetRegistry();
+    std::unique_lock<std::mutex> lock(registry.mutex);
+    state.backing = backing;
+    state.backed = bool(backing);
+    state.origin.clear();
+    if (backing)
+    {
+      state.ticket = ++registry.tickets;
+      registry.raws.insert(this);
+    }
+    else
+    {
+      registry.raws.erase(this);
+    }
+  }
+
+  bool Raw::SetBacking(const backing_t& backing, uint32_t generation, const std::string& origin)
+  {
+    auto& state = GetState();
+
+    auto& registry = GetRegistry();
+    std::unique_lock<std::mutex> lock(registry.mutex);
+    state.backing = backing;
+    state.backed = true;
+    state.origin = origin;
+    state.ticket = ++registry.tickets;
+    registry.raws.insert(this);
+
+    // published before the generation is checked, see DropBacking
+    if (state.generation.load() == generation)
+    {
+      return true;
+    }
+
+    state.backing = nullptr;
+    state.backed = false;
+    state.origin.clear();
+    registry.raws.erase(this);
+    return false;
+  }
+
+  std::string Raw::GetOrigin() const
+  {
+    if (!IsBacked())
+    {
+      return std::string();
+    }
+
+    auto& registry = GetRegistry();
+    std::unique_lock<std::mutex> lock(registry.mutex);
+    return _state->backed ? _state->origin : std::string();
+  }
+
+  void Raw::Account(int64_t bytes, int32_t count)
+  {
+    auto& registry = GetRegistry();
+    registry.resident_bytes.fetch_add(uint64_t(bytes));
+    registry.resident_count.fetch_add(uint32_t(count));
+  }
+
+  void Raw::MarkDirty(uint32_t offset, uint32_t size)
+  {
+    auto& state = GetState();
+    auto& dirty = state.dirty;
+
+    state.generation += 1;
+    if (size == 0)
+    {
+      return;
+    }
+
+    auto begin = offset;
+    auto end = offset + size;
+
+    // absorb every range that overlaps or touches the new one
+    auto first = std::lower_bound(dirty.begin(), dirty.end(), begin,
+      [](const auto& range, uint32_t value) { return range.second < value; });
+    auto last = first;
+    while (last != dirty.end() && last->first <= end)
+    {
+      begin = std::min(begin, last->first);
+      end = std::max(end, last->second);
+      ++last;
+    }
+
+    if (first == last)
+    {
+      dirty.insert(first, { begin, end });
+    }
+    else
+    {
+      *first = { begin, end };
+      dirty.erase(first + 1, last);
+    }
+  }
+
+  void Raw::Materialize(uint32_t offset, uint32_t size) const
+  {
+    if (_bytes.first == nullptr && _bytes.second != 0)
+    {
+      auto& registry = GetRegistry();
+      std::unique_lock<std::mutex> lock(registry.reload_mutex);
+      if (_bytes.first == nullptr)
+      {
+        _bytes.first = Acquire(_bytes.second);
+        Account(_bytes.second, 1);
+        registry.reloads += 1;
+        registry.reloaded_bytes += _bytes.second;
+      }
+    }
+
+    _state->source->Fetch(_bytes.first, offset, size);
+  }
+
+  bool Raw::Evict()
+  {
+    std::vector<Victim> victims;
+    {
+      auto& registry = GetRegistry();
+      std::unique_lock<std::mutex> lock(registry.mutex);
+      if (!IsEvictable())
+      {
+        return false;
+      }
+      victims.push_back({ this, _state->ticket, _state->generation.load(), _bytes.second, _state->backing, nullptr });
+    }
+    return Release(victims) != 0;
+  }
+
+  uint32_t Raw::Release(std::vector<Victim>& victims)
+  {
+    // a backing may open its file, so none is called with the registry lock held
+    for (auto& victim : victims)
+    {
+      victim.source = victim.backing();
+    }
+
+    auto& registry = GetRegistry();
+    std::unique_lock<std::mutex> lock(registry.mutex);
+
+    uint32_t released = 0;
+    for (const auto& victim : victims)
+    {
+      if (!victim.source || victim.source->GetSize() != victim.size) continue;
+
+      // the raw may have been written, rebacked or destroyed meanwhile
+      const auto raw = victim.raw;
+      if (registry.raws.count(raw) == 0 || raw->_state->ticket != victim.ticket) continue;
+      if (raw->_state->generation.load() != victim.generation || !raw->IsEvictable()) continue;
+
+      raw->Dispose();
+      raw->_bytes.first = nullptr;
+      raw->_state->source = victim.source;
+      Account(-int64_t(victim.size), -1);
+
+      registry.evictions += 1;
+      registry.evicted_bytes += victim.size;
+      released += 1;
+    }
+    return released;
+  }
+
+  Raw& Raw::operator=(Raw&& other)
+  {
+    if (this == &other)
+    {
+      return *this;
+    }
+
+    if (_bytes.second != 0) Free();
+    DropBacking();
+
+    // the registry entry follows the state, moves of unbacked raws never lock
+    std::unique_lock<std::mutex> lock;
+    if (other.IsBacked())
+    {
+      auto& registry = GetRegistry();
+      lock = std::unique_lock<std::mutex>(registry.mutex);
+      registry.raws.erase(&other);
+      registry.raws.insert(this);
+    }
+
+    // the generation never goes back, so consumers of either raw see the change
+    const auto generation = std::max(GetGeneration(), other.GetGeneration());
+
+    _bytes = other._bytes;
+    _state = std::move(other._state);
+    if (generation != 0) GetState().generation = generation + 1;
+
+    other._bytes = { nullptr, 0 };
+
+    return *this;
+  }
+
+  uint8_t* Raw::Acquire(uint32_t size) const
+  {
+    _state->mapped = 0;
+
+#ifdef __linux__
+    auto& registry = GetRegistry();
+    const auto custom = _state->policy.has_value();
+    if (custom || registry.policy_custom)
+    {
+      const auto policy = custom ? *_state->policy : GetDefaultPolicy();
+      const auto placed = policy.interleave || policy.node >= 0;
+      if (size != 0 && size >= policy.threshold && (placed || policy.pages != PAGES_DEFAULT))
+      {
+        void* data = MAP_FAILED;
+        size_t length = 0;
+        if (policy.pages == PAGES_EXPLICIT)
+        {
+          length = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+          data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        }
+        if (data == MAP_FAILED && policy.pages != PAGES_DEFAULT)
+        {
+          length = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+          data = MapAligned(length);
+          if (data != MAP_FAILED) madvise(data, length, MADV_HUGEPAGE);
+        }
+        if (data == MAP_FAILED)
+        {
+          const auto page = size_t(sysconf(_SC_PAGESIZE));
+          length = (size + page - 1) & ~(page - 1);
+          data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+
+        if (data != MAP_FAILED)
+        {
+          // pages are placed on first touch, so binding before any write is enough
+          if (placed) Bind(data, length, policy);
+          _state->mapped = length;
+          return static_cast<uint8_t*>(data);
+        }
+      }
+    }
+#endif
+
+    return new uint8_t[size];
+  }
+
+  void Raw::Dispose() const
+  {
+#ifdef __linux__
+    if (_state && _state->mapped != 0)
+    {
+      munmap(_bytes.first, _state->mapped);
+      _state->mapped = 0;
+      return;
+    }
+#endif
+
+    delete[] _bytes.first;
+  }
+
+  void Raw::SetDefaultPolicy(const Policy& policy)
+  {
+    auto& registry = GetRegistry();
+    std::unique_lock<std::mutex> lock(registry.policy_mutex);
+    registry.policy = policy;
+    registry.policy_custom = policy.node >= 0 || policy.interleave || policy.pages != PAGES_DEFAULT;
+  }
+
+  Raw::Policy Raw::GetDefaultPolicy()
+  {
+    auto& registry = GetRegistry();
+    std::unique_lock<std::mutex> lock(registry.policy_mutex);
+    return registry.policy;
+  }
+
+  void Raw::SetBudget(uint64_t bytes)
+  {
+    GetRegistry().budget = bytes;
+  }
+
+  uint64_t Raw::GetBudget()
+  {
+    return GetRegistry().budget;
+  }
+
+  Raw::Residency Raw::GetResidency()
+  {
+    auto& registry = GetRegistry();
+
+    Residency residency;
+    residency.budget = registry.budget;
+    residency.resident_bytes = registry.resident_bytes;
+    residency.resident_count = registry.resident_count;
+    residency.evictions = registry.evictions;
+    residency.evicted_bytes = registry.evicted_bytes;
+    residency.reloads = registry.reloads;
+    residency.reloaded_bytes = registry.reloaded_bytes;
+
+    std::unique_lock<std::mutex> lock(registry.mutex);
+    for (const auto raw : registry.raws)
+    {
+      if (raw->IsEvictable()) residency.evictable_count += 1;
+    }
+
+    return residency;
+  }
+
+  std::shared_lock<std::shared_mutex> Raw::Hold()
+  {
+    return std::shared_lock<std::shared_mutex>(GetRegistry().hold);
+  }
+
+  void Raw::Trim()
+  {
+    auto& registry = GetRegistry();
+
+    const auto budget = registry.budget.load();
+    if (budget != 0 && registry.resident_bytes > budget)
+    {
+      std::unique_lock<std::shared_mutex> hold(registry.hold, std::try_to_lock);
+      if (!hold.owns_lock())
+      {
+        frame += 1;
+        return;
+      }
+
+      // least recently touched payloads go first, until the budget would be met
+      victims.clear();
+      {
+        std::unique_lock<std::mutex> lock(registry.mutex);
+
+        auto& candidates = registry.candidates;
+        candidates.clear();
+        for (const auto raw : registry.raws)
+        {
+          if (!raw->IsEvictable()) continue;
+          candidates.push_back({ raw->_state->access.load(std::memory_order_relaxed), raw });
+        }
+        std::sort(candidates.begin(), candidates.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+        auto resident = registry.resident_bytes.load();
+        for (const auto& [access, raw] : candidates)
+        {
+          if (resident <= budget) break;
+          victims.push_back({ raw, raw->_state->ticket, raw->_state->generation.load(), raw->_bytes.second, raw->_state->backing, nullptr });
+          resident -= std::min(resident, uint64_t(raw->_bytes.second));
+        }
+      }
+
+      Release(victims);
+      victims.clear();
+    }
+
+    frame += 1;
+  }
+
+  void BufferedRaw::Allocate(uint32_t size)
+  {
+    for (auto& buffer : buffers)
+    {
+      if (buffer.GetSize() != 0) buffer.Free();
+      buffer.Allocate(size);
+      buffer.ClearDirty();
+    }
+    history.clear();
+  }
+
+  void BufferedRaw::Publish()
+  {
+    published += 1;
+    stamps[back] = published;
+    latest = back;
+    history.push_back({ published, buffers[back].GetDirty() });
+    buffers[back].ClearDirty();
+
+    back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & ~FRESH;
+
+    // replay everything published after this copy was last written
+    if (stamps[back] != published)
+    {
+      const auto& source = buffers[latest];
+      for (const auto& [stamp, ranges] : history)
+      {
+        if (stamp <= stamps[back]) continue;
+        for (const auto& [begin, end] : ranges)
+        {
+          buffers[back].SetBytes(source.GetBytes(begin, end - begin), begin);
+        }
+      }
+      buffers[back].ClearDirty();
+      stamps[back] = published;
+    }
+
+    const auto oldest = std::min({ stamps[0], stamps[1], stamps[2] });
+    while (!history.empty() && history.front().first <= oldest)
+    {
+      history.pop_front();
+    }
+  }
+
+  const Raw& BufferedRaw::Acquire()
+  {
+    if (middle.load(std::memory_order_relaxed) & FRESH)
+    {
+      front = middle.exchange(front, std::memory_order_acq_rel) & ~FRESH;
+    }
+    return buffers[front];
+  }
+}
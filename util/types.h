@@ -30,6 +30,12 @@ THE SOFTWARE.
 #pragma once
 #include "../../raygene3d-wrap/base.h"
 
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <shared_mutex>
+
 #define GLM_FORCE_LEFT_HANDED
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_FORCE_RADIANS
@@ -173,8 +179,155 @@ namespace RayGene3D
 
   class Raw
   {
+  public:
+    // content that is materialised into the allocation on first access
+    class Source
+    {
+    public:
+      virtual uint32_t GetSize() const = 0;
+      virtual void Fetch(uint8_t* bytes, uint32_t offset, uint32_t size) = 0;
+
+    public:
+      virtual ~Source() {}
+    };
+
+    // recreates the content from a persisted copy after an eviction
+    typedef std::function<std::shared_ptr<Source>()> backing_t;
+
+  public:
+    // element type hint used to pick a dedicated codec when persisting
+    enum Layout
+    {
+      LAYOUT_UNKNOWN = 0,
+      LAYOUT_VERTEX = 1,
+      LAYOUT_TRIANGLE = 2,
+    };
+
+  public:
+    enum Pages
+    {
+      PAGES_DEFAULT = 0,
+      PAGES_TRANSPARENT = 1,  // madvise(MADV_HUGEPAGE)
+      PAGES_EXPLICIT = 2,     // MAP_HUGETLB, transparent when the reserved pool is empty
+    };
+
+    // placement of the payload, payloads below the threshold stay on the heap
+    struct Policy
+    {
+      int32_t node{ -1 };        // preferred NUMA node, -1 for none
+      bool interleave{ false };  // pages spread over all nodes, overrides node
+      Pages pages{ PAGES_DEFAULT };
+      uint32_t threshold{ 2u << 20 };
+    };
+
+  public:
+    struct Residency
+    {
+      uint64_t budget{ 0 };
+      uint64_t resident_bytes{ 0 };
+      uint32_t resident_count{ 0 };
+      uint32_t evictable_count{ 0 };
+      uint32_t evictions{ 0 };
+      uint64_t evicted_bytes{ 0 };
+      uint32_t reloads{ 0 };
+      uint64_t reloaded_bytes{ 0 };
+    };
+
+  protected:
+    // kept out of line, so that empty raws and the property variant stay small
+    struct State
+    {
+      std::shared_ptr<Source> source;
+      backing_t backing;
+      std::atomic<bool> backed{ false };
+      uint64_t ticket{ 0 };  // tells the backings apart, set with the registry lock held
+      std::string origin;    // what the backing reads from, empty when unnamed
+      Layout layout{ LAYOUT_UNKNOWN };
+      std::atomic<uint32_t> access{ 0 };
+      size_t mapped{ 0 };  // length of the mapping, 0 for heap payloads
+      std::optional<Policy> policy;
+
+      // sorted, non-adjacent [begin, end) byte ranges written since the last clear
+      std::vector<std::pair<uint32_t, uint32_t>> dirty;
+      std::atomic<uint32_t> generation{ 0 };
+    };
+
+    // an evictable raw as seen under the registry lock, released only if it
+    // is unchanged once its backing has produced the source outside the lock
+    struct Victim
+    {
+      Raw* raw{ nullptr };
+      uint64_t ticket{ 0 };
+      uint32_t generation{ 0 };
+      uint32_t size{ 0 };
+      backing_t backing;
+      std::shared_ptr<Source> source;
+    };
+
   protected:
-    std::pair<uint8_t*, uint32_t> _bytes{ nullptr, 0 };
+    mutable std::pair<uint8_t*, uint32_t> _bytes{ nullptr, 0 };
+    std::unique_ptr<State> _state;
+
+  protected:
+    static std::atomic<uint32_t> frame;
+    static const std::vector<std::pair<uint32_t, uint32_t>> clean;
+    static std::vector<Victim> victims;  // kept between frames, only Trim touches it
+
+  protected:
+    static void Account(int64_t bytes, int32_t count);
+    void Materialize(uint32_t offset, uint32_t size) const;
+    static uint32_t Release(std::vector<Victim>& victims);
+    State& GetState() { if (!_state) _state.reset(new State()); return *_state; }
+    bool IsBacked() const { return _state && _state->backed.load(std::memory_order_relaxed); }
+    bool IsSourced() const { return _state && _state->source; }
+    void Touch() const { if (_state) _state->access.store(frame.load(std::memory_order_relaxed), std::memory_order_relaxed); }
+    // writers move the generation first, so either a concurrent SetBacking
+    // sees the new generation or this sees its backing and drops it
+    void DropBacking() { if (_state && _state->backed.load()) SetBacking(nullptr); }
+    void MarkDirty(uint32_t offset, uint32_t size);
+    uint8_t* Acquire(uint32_t size) const;
+    void Dispose() const;
+
+  public:
+    // an evicted raw keeps its size and is paged back in on the next access
+    bool IsResident() const { return _bytes.first != nullptr || _bytes.second == 0; }
+    bool IsEvictable() const { return IsBacked() && _bytes.first != nullptr; }
+    bool Evict();
+
+  public:
+    // pointers handed out by GetBytes stay valid until the next Trim, so the
+    // budget is only enforced at frame boundaries and never on access
+    static void SetBudget(uint64_t bytes);
+    static uint64_t GetBudget();
+    static Residency GetResidency();
+    static void Trim();
+    // held by storage operations running off the calling thread; Trim skips a
+    // frame instead of waiting while any hold is outstanding
+    static std::shared_lock<std::shared_mutex> Hold();
+
+  public:
+    // Applies to allocations made afterwards; without one the default policy
+    // is used. NUMA placement and huge pages are only available on Linux.
+    static void SetDefaultPolicy(const Policy& policy);
+    static Policy GetDefaultPolicy();
+    void SetPolicy(const Policy& policy) { GetState().policy = policy; }
+    const Policy* GetPolicy() const { return _state && _state->policy ? &*_state->policy : nullptr; }
+    bool IsMapped() const { return _state && _state->mapped != 0; }
+
+  public:
+    void SetLayout(Layout layout) { GetState().layout = layout; }
+    Layout GetLayout() const { return _state ? _state->layout : LAYOUT_UNKNOWN; }
+    void SetBacking(const backing_t& backing);
+    // only if no write happened since the generation was read, false otherwise
+    bool SetBacking(const backing_t& backing, uint32_t generation, const std::string& origin = std::string());
+    // the origin of the current backing, empty once the raw was written
+    std::string GetOrigin() const;
+
+  public:
+    // consumers upload only these ranges, the generation changes on every write
+    const std::vector<std::pair<uint32_t, uint32_t>>& GetDirty() const { return _state ? _state->dirty : clean; }
+    uint32_t GetGeneration() const { return _state ? _state->generation.load() : 0; }
+    void ClearDirty() { if (_state) _state->dirty.clear(); }
 
   public:
     void Allocate(uint32_t size)
@@ -184,19 +337,44 @@ namespace RayGene3D
         throw std::runtime_error("allocation failed");
       }
 
-      _bytes.first = new uint8_t[size];
+      GetState();
+      _bytes.first = Acquire(size);
       _bytes.second = size;
+      Account(size, 1);
+      MarkDirty(0, size);
     }
 
     void Free()
     {
-      if (_bytes.first == nullptr || _bytes.second == 0)
+      if (_bytes.second == 0)
       {
         throw std::runtime_error("freeing failed");
       }
 
-      delete[] _bytes.first;
+      if (_bytes.first != nullptr)
+      {
+        Dispose();
+        Account(-int64_t(_bytes.second), -1);
+      }
+      _state->generation += 1;
+      DropBacking();
       _bytes = { nullptr, 0 };
+      _state->source.reset();
+      _state->dirty.clear();
+    }
+
+    void Attach(const std::shared_ptr<Source>& source)
+    {
+      const auto size = source->GetSize();
+      if (_bytes.second != size || _bytes.first == nullptr)
+      {
+        if (_bytes.second != 0) Free();
+        Allocate(size);
+      }
+
+      GetState().source = source;
+      MarkDirty(0, size);
+      DropBacking();
     }
 
     void SetBytes(std::pair<const void*, uint32_t> bytes, uint32_t offset)
@@ -206,12 +384,24 @@ namespace RayGene3D
         throw std::runtime_error("set bytes failed");
       }
 
-      if (bytes.first != nullptr && bytes.second + offset <= _bytes.second)
+      if (IsSourced())
+      {
+        Materialize(0, _bytes.second);
+        _state->source.reset();
+      }
+      const auto fits = bytes.first != nullptr && bytes.second + offset <= _bytes.second;
+      if (fits) MarkDirty(offset, bytes.second);
+      DropBacking();
+      Touch();
+
+      if (fits)
       {
         std::memcpy(_bytes.first + offset, bytes.first, bytes.second);
       }
     }
 
+    uint32_t GetSize() const { return _bytes.second; }
+
     std::pair<const void*, uint32_t> GetBytes(uint32_t offset) const
     {
       if (offset > _bytes.second)
@@ -219,12 +409,89 @@ namespace RayGene3D
         throw std::runtime_error("get bytes failed");
       }
 
+      if (IsSourced())
+      {
+        Materialize(offset, _bytes.second - offset);
+      }
+      Touch();
+
       return { _bytes.first + offset, _bytes.second - offset };
     }
 
+    std::pair<const void*, uint32_t> GetBytes(uint32_t offset, uint32_t size) const
+    {
+      if (offset > _bytes.second || size > _bytes.second - offset)
+      {
+        throw std::runtime_error("get bytes failed");
+      }
+
+      if (IsSourced())
+      {
+        Materialize(offset, size);
+      }
+      Touch();
+
+      return { _bytes.first + offset, size };
+    }
+
+  public:
+    Raw& operator=(Raw&& other);
+
   public:
     Raw() {}
-    ~Raw() { Free(); }
+    Raw(Raw&& other) { *this = std::move(other); }
+    ~Raw()
+    {
+      DropBacking();
+      if (_bytes.first != nullptr)
+      {
+        Dispose();
+        Account(-int64_t(_bytes.second), -1);
+      }
+    }
   };
-}
 
+  // Triple-buffered payload for one writer and one reader thread. The writer
+  // fills the back copy and publishes it by swapping it with the middle one,
+  // the reader swaps a freshly published middle copy into the front, so both
+  // sides always own a complete copy and never wait for each other. A copy the
+  // writer gets back is brought up to date by replaying only the ranges
+  // written since it was last published.
+  class BufferedRaw
+  {
+  protected:
+    static const uint32_t FRESH = 0x4;
+
+  protected:
+    Raw buffers[3];
+    std::atomic<uint32_t> middle{ 1 };
+    uint32_t back{ 0 };
+    uint32_t front{ 2 };
+
+  protected:
+    // writer side only: publish stamp of every copy and the ranges of each publish
+    uint32_t stamps[3]{ 0, 0, 0 };
+    uint32_t published{ 0 };
+    uint32_t latest{ 0 };
+    std::deque<std::pair<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>>> history;
+
+  public:
+    void Allocate(uint32_t size);
+    uint32_t GetSize() const { return buffers[back].GetSize(); }
+
+  public:
+    // writer thread
+    void SetBytes(std::pair<const void*, uint32_t> bytes, uint32_t offset) { buffers[back].SetBytes(bytes, offset); }
+    Raw& GetBack() { return buffers[back]; }
+    void Publish();
+
+  public:
+    // reader thread, the returned copy stays untouched until the next Acquire
+    const Raw& Acquire();
+    const Raw& GetFront() const { return buffers[front]; }
+
+  public:
+    BufferedRaw() {}
+    ~BufferedRaw() {}
+  };
+}